@@ -1,4 +1,19 @@
 #include "MCJIT_helper.h"
+#include <llvm\Object\SymbolSize.h>
+#include <llvm\Analysis\TargetTransformInfo.h>
+#include <llvm\Target\TargetMachine.h>
+#include <llvm\Transforms\Scalar.h>
+#include <llvm\Transforms\Vectorize.h>
+#include <llvm\Support\DynamicLibrary.h>
+#include <llvm\IR\CFG.h>
+#include <set>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 namespace summer_lang
 {
@@ -9,6 +24,9 @@ namespace summer_lang
 
 		for (auto i = engines_.begin(); i != engines_.end(); ++i)
 			delete *i;
+
+		for (auto & literal : literals_)
+			lib::destroy_string(literal.second);
 	}
 
 	llvm::Function * MCJIT_helper::get_function(const std::string & name)
@@ -32,6 +50,18 @@ namespace summer_lang
 		return nullptr;
 	}
 
+	//unlike get_function, this does not declare the function in the open module
+	llvm::Function * MCJIT_helper::find_definition(const std::string & name) const
+	{
+		for (auto module : modules_)
+		{
+			auto function = module->getFunction(name);
+			if (function && !function->isDeclaration())
+				return function;
+		}
+		return nullptr;
+	}
+
 	llvm::Module * MCJIT_helper::get_module_for_new_function()
 	{
 		if (!open_module_)
@@ -39,46 +69,151 @@ namespace summer_lang
 			open_module_ = new llvm::Module("mcjit_module", context_);
 			open_module_->setTargetTriple("i686-pc-windows-msvc-elf");
 			modules_.push_back(open_module_);
+			if (debug_info_)
+				debug_info_->begin_module(open_module_);
 		}
 		return open_module_;
 	}
 
-	void * MCJIT_helper::get_pointer_to_function(llvm::Function * function)
+	llvm::Module * MCJIT_helper::get_module_for_anonymous_function()
 	{
-		for (auto i = engines_.begin(); i != engines_.end(); ++i)
+		//anonymous functions are released right after they run, so they must not share a module with named definitions
+		if (open_module_ && open_module_is_anonymous_)
+			return open_module_;
+		if (open_module_)
+			compile_open_module_();
+		auto module = get_module_for_new_function();
+		open_module_is_anonymous_ = true;
+		return module;
+	}
+
+	static void add_optimization_passes(llvm::legacy::FunctionPassManager & fpm)
+	{
+		fpm.add(llvm::createInstructionCombiningPass());
+		fpm.add(llvm::createTailCallEliminationPass());
+		fpm.add(llvm::createReassociatePass());
+		fpm.add(llvm::createGVNPass());
+		fpm.add(llvm::createCFGSimplificationPass());
+		//loops are put into canonical form first, the vectorizer needs a computable trip count
+		fpm.add(llvm::createLoopRotatePass());
+		fpm.add(llvm::createLICMPass());
+		fpm.add(llvm::createIndVarSimplifyPass());
+		fpm.add(llvm::createLoopVectorizePass());
+		fpm.add(llvm::createInstructionCombiningPass());
+		fpm.add(llvm::createCFGSimplificationPass());
+	}
+
+	//codegen appends blocks in order, so a branch to a block placed before it is the back edge of a loop
+	static bool has_loop(llvm::Module & module)
+	{
+		for (auto & function : module)
 		{
-			if (auto addr = (*i)->getPointerToFunction(function))
-				return addr;
+			std::set<const llvm::BasicBlock *> placed;
+			for (auto & block : function)
+			{
+				placed.insert(&block);
+				for (auto successor = llvm::succ_begin(&block); successor != llvm::succ_end(&block); ++successor)
+					if (placed.count(*successor))
+						return true;
+			}
 		}
+		return false;
+	}
 
-		if (open_module_)
+	llvm::ExecutionEngine * MCJIT_helper::compile_open_module_()
+	{
+		if (debug_info_)
+			debug_info_->finish_module();
+
+		auto anonymous = open_module_is_anonymous_;
+		auto quick = anonymous && quick_anonymous_ && !has_loop(*open_module_);
+		std::string error_str;
+		auto memory_manager = std::make_unique<HelpingMemoryManager>(this, open_module_is_anonymous_ ? transient_slabs_ : resident_slabs_);
+		auto p_memory_manager = memory_manager.get();
+		llvm::TargetOptions options;
+		if (fast_math_)
+		{
+			options.AllowFPOpFusion = llvm::FPOpFusion::Fast;
+			options.UnsafeFPMath = true;
+			options.NoInfsFPMath = true;
+			options.NoNaNsFPMath = true;
+		}
+
+		auto new_engine = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(open_module_))
+			.setErrorStr(&error_str)
+			.setMCJITMemoryManager(std::move(memory_manager))
+			.setTargetOptions(options)
+			.setOptLevel(quick ? llvm::CodeGenOpt::None : llvm::CodeGenOpt::Default)
+			.create();
+		if (!new_engine)
 		{
-			std::string error_str;
-			auto new_engine = llvm::EngineBuilder(std::unique_ptr<llvm::Module>(open_module_))
-				.setErrorStr(&error_str)
-				.setMCJITMemoryManager(std::make_unique<HelpingMemoryManager>(this))
-				.create();
-			if (!new_engine)
+			throw std::exception(("Can't create Execution Engine: " + error_str).c_str());
+			exit(1);
+		}
+
+		auto fpm = new llvm::legacy::FunctionPassManager(open_module_);
+		open_module_->setDataLayout(*new_engine->getDataLayout());
+		fpm->add(llvm::createTargetTransformInfoWrapperPass(new_engine->getTargetMachine()->getTargetIRAnalysis()));
+		fpm->add(llvm::createBasicAliasAnalysisPass());
+		fpm->add(llvm::createPromoteMemoryToRegisterPass());
+		if (!quick)
+			add_optimization_passes(*fpm);
+		fpm->doInitialization();
+
+		module_statistics module_record = {};
+		for (auto i = open_module_->begin(); i != open_module_->end(); ++i)
+		{
+			function_statistics * record = nullptr;
+			if (statistics_ && !i->isDeclaration())
 			{
-				throw std::exception(("Can't create Execution Engine: " + error_str).c_str());
-				exit(1);
+				module_record.functions.push_back(i->getName());
+				record = statistics_->find_function(i->getName());
 			}
 
-			auto fpm = new llvm::legacy::FunctionPassManager(open_module_);
-			open_module_->setDataLayout(*new_engine->getDataLayout());
-			fpm->add(llvm::createBasicAliasAnalysisPass());
-			fpm->doInitialization();
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::OPTIMIZE)] : nullptr);
+			fpm->run(*i);
+		}
+
+		delete fpm;
 
-			for (auto i = open_module_->begin(); i != open_module_->end(); ++i)
-				fpm->run(*i);
+		//a name resolved to the process before the program defined it now means the new definition
+		for (auto & defined : *open_module_)
+			if (!defined.isDeclaration())
+				symbols_.erase(defined.getName());
 
-			delete fpm;
-			open_module_ = nullptr;
-			engines_.push_back(new_engine);
+		open_module_ = nullptr;
+		open_module_is_anonymous_ = false;
+		engines_.push_back(new_engine);
+		for (auto listener : listeners_)
+			new_engine->RegisterJITEventListener(listener);
+		//a perf map can not take entries back, and anonymous code is freed after one run and its addresses reused
+		if (jit_symbols_ && !anonymous)
+			new_engine->RegisterJITEventListener(&PerfMapEventListener::get());
+		{
+			phase_timer timer(statistics_ ? &module_record.emit_seconds : nullptr);
 			new_engine->finalizeObject();
-			return new_engine->getPointerToFunction(function);
 		}
 
+		if (statistics_)
+		{
+			module_record.machine_code_bytes = p_memory_manager->get_code_size();
+			statistics_->add_module(std::move(module_record));
+			statistics_->set_memory(resident_memory_, get_memory_statistics());
+		}
+		return new_engine;
+	}
+
+	void * MCJIT_helper::get_pointer_to_function(llvm::Function * function)
+	{
+		for (auto i = engines_.begin(); i != engines_.end(); ++i)
+		{
+			if (auto addr = (*i)->getPointerToFunction(function))
+				return addr;
+		}
+
+		if (open_module_)
+			return compile_open_module_()->getPointerToFunction(function);
+
 		return nullptr;
 	}
 
@@ -92,6 +227,83 @@ namespace summer_lang
 		return nullptr;
 	}
 
+	//looks in the compiled modules first, so a function of the program hides a runtime or library symbol of the same name,
+	//such as the libm targets of the math builtins, then in the host process and the loaded libraries
+	uint64_t MCJIT_helper::resolve_symbol(const std::string & name)
+	{
+		auto cached = symbols_.find(name);
+		if (cached != symbols_.end())
+			return cached->second;
+
+		auto address = (uint64_t)get_symbol_address(name);
+		if (!address)
+			address = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name);
+		if (address)
+			symbols_[name] = address;
+		return address;
+	}
+
+	//the library stays loaded for the rest of the session, its symbols become visible to every 'extern'
+	void MCJIT_helper::load_library(const std::string & path)
+	{
+		std::string error_str;
+		auto library = llvm::sys::DynamicLibrary::getPermanentLibrary(path.c_str(), &error_str);
+		if (!library.isValid())
+			throw std::exception(("Can't load library " + path + ": " + error_str).c_str());
+	}
+
+	void MCJIT_helper::release_function(llvm::Function * function)
+	{
+		auto module = function->getParent();
+		for (auto & defined : *module)
+			if (!defined.isDeclaration())
+				symbols_.erase(defined.getName());
+		for (std::size_t i = 0; i != engines_.size(); ++i)
+		{
+			if (modules_[i] == module)
+			{
+				//deleting the engine frees the module and, through its memory manager, the code pages
+				delete engines_[i];
+				engines_.erase(engines_.begin() + i);
+				modules_.erase(modules_.begin() + i);
+				if (statistics_)
+					statistics_->set_memory(resident_memory_, get_memory_statistics());
+				return;
+			}
+		}
+	}
+
+	void MCJIT_helper::enable_jit_symbols()
+	{
+		if (jit_symbols_)
+			return;
+
+		jit_symbols_ = true;
+		listeners_.push_back(llvm::JITEventListener::createGDBRegistrationListener());
+	}
+
+	void MCJIT_helper::enable_debug_info(const std::string & source_name)
+	{
+		debug_info_ = std::make_unique<debug_info>(source_name);
+		if (open_module_)
+			debug_info_->begin_module(open_module_);
+	}
+
+	string_object * MCJIT_helper::intern_string(const std::string & value)
+	{
+		auto & literal = literals_[value];
+		if (!literal)
+			literal = lib::make_literal(value);
+		return literal;
+	}
+
+	//literals live outside of the JIT modules and are referenced by their address, so equal literals share one copy
+	llvm::Constant * MCJIT_helper::get_string_literal(const std::string & value)
+	{
+		auto address = llvm::ConstantInt::get(llvm::Type::getIntNTy(context_, sizeof(void *) * 8), reinterpret_cast<uintptr_t>(intern_string(value)));
+		return llvm::ConstantExpr::getIntToPtr(address, llvm::Type::getInt8PtrTy(context_));
+	}
+
 	std::string MCJIT_helper::generate_function_name(const std::string & name)
 	{
 		if (!name.length())
@@ -99,16 +311,87 @@ namespace summer_lang
 		return name;
 	}
 
-	uint64_t HelpingMemoryManager::getSymbolAddress(const std::string & name)
+	HelpingMemoryManager::~HelpingMemoryManager()
+	{
+		for (auto & section : sections_)
+			allocator_.release(std::get<0>(section), std::get<1>(section), std::get<2>(section));
+		helper_->resident_memory_ -= allocated_;
+	}
+
+	uint8_t * HelpingMemoryManager::allocateCodeSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name)
 	{
-		auto p_func = llvm::SectionMemoryManager::getSymbolAddress(name);
-		if (p_func)
-			return p_func;
+		auto address = allocator_.allocate(section_categories::CODE, size, alignment);
+		if (!address)
+			return nullptr;
 
-		p_func = (uint64_t)helper_->get_symbol_address(name);
+		sections_.push_back(std::make_tuple(section_categories::CODE, address, size));
+		code_size_ += size;
+		allocated_ += size;
+		helper_->resident_memory_ += size;
+		return address;
+	}
+
+	uint8_t * HelpingMemoryManager::allocateDataSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name, bool is_read_only)
+	{
+		auto category = is_read_only ? section_categories::READ_ONLY_DATA : section_categories::DATA;
+		auto address = allocator_.allocate(category, size, alignment);
+		if (!address)
+			return nullptr;
+
+		sections_.push_back(std::make_tuple(category, address, size));
+		allocated_ += size;
+		helper_->resident_memory_ += size;
+		return address;
+	}
+
+	bool HelpingMemoryManager::finalizeMemory(std::string * error_str)
+	{
+		return allocator_.finalize(error_str);
+	}
+
+	uint64_t HelpingMemoryManager::getSymbolAddress(const std::string & name)
+	{
+		auto p_func = helper_->resolve_symbol(name);
 		if (!p_func)
 			throw std::exception(("Program used extern function '" + name + "' which could not be resolved!").c_str());
 
 		return p_func;
 	}
+
+	PerfMapEventListener::PerfMapEventListener()
+		: map_("/tmp/perf-" + std::to_string(getpid()) + ".map")
+	{
+	}
+
+	PerfMapEventListener & PerfMapEventListener::get()
+	{
+		static PerfMapEventListener listener;
+		return listener;
+	}
+
+	void PerfMapEventListener::NotifyObjectEmitted(const llvm::object::ObjectFile & object, const llvm::RuntimeDyld::LoadedObjectInfo & info)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!map_.is_open())
+			return;
+
+		//the debug copy of the object carries the addresses the sections were loaded at
+		auto debug_object = info.getObjectForDebug(object);
+		if (!debug_object.getBinary())
+			return;
+
+		for (auto & symbol_size : llvm::object::computeSymbolSizes(*debug_object.getBinary()))
+		{
+			auto symbol = symbol_size.first;
+			if (symbol.getType() != llvm::object::SymbolRef::ST_Function)
+				continue;
+
+			auto name = symbol.getName();
+			auto address = symbol.getAddress();
+			if (!name || !address)
+				continue;
+
+			map_ << std::hex << *address << " " << symbol_size.second << std::dec << " " << name->str() << std::endl;
+		}
+	}
 }
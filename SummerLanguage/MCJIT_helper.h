@@ -3,7 +3,8 @@
 #include <llvm\ExecutionEngine\ExecutionEngine.h>
 #include <llvm\ExecutionEngine\MCJIT.h>
 #include <llvm\Analysis\Passes.h>
-#include <llvm\ExecutionEngine\SectionMemoryManager.h>
+#include <llvm\ExecutionEngine\RTDyldMemoryManager.h>
+#include <llvm\ExecutionEngine\JITEventListener.h>
 #include <llvm\IR\DataLayout.h>
 #include <llvm\IR\LLVMContext.h>
 #include <llvm\IR\Module.h>
@@ -11,8 +12,16 @@
 #include <llvm\IR\Verifier.h>
 #include <vector>
 #include <memory>
+#include <tuple>
+#include <fstream>
+#include <unordered_map>
+#include <mutex>
 
 #include "error.h"
+#include "slab_allocator.h"
+#include "statistics.h"
+#include "debug_info.h"
+#include "lib.h"
 
 namespace summer_lang
 {
@@ -20,37 +29,142 @@ namespace summer_lang
 	{
 		llvm::LLVMContext & context_;
 		llvm::Module * open_module_;
-		std::vector<llvm::Module *> modules_;
+		bool open_module_is_anonymous_;
+		std::vector<llvm::Module *> modules_;		//modules_[i] is owned by engines_[i] once it is compiled
 		std::vector<llvm::ExecutionEngine *> engines_;
+		std::size_t resident_memory_;
+		slab_allocator resident_slabs_;
+		slab_allocator transient_slabs_;		//code of anonymous functions, rewound after every run
+		compile_statistics * statistics_;
+		std::vector<llvm::JITEventListener *> listeners_;
+		bool jit_symbols_;
+		std::unique_ptr<debug_info> debug_info_;
+		bool fast_math_;
+		bool quick_anonymous_;
+		std::unordered_map<std::string, string_object *> literals_;		//immortal, freed with the helper
+		std::unordered_map<std::string, uint64_t> symbols_;		//addresses of resolved externs and compiled functions
+
+		llvm::ExecutionEngine * compile_open_module_();
+
+		friend class HelpingMemoryManager;
 	public:
 		MCJIT_helper(llvm::LLVMContext & context)
 			: context_(context)
 			, open_module_(nullptr)
+			, open_module_is_anonymous_(false)
+			, resident_memory_(0)
+			, statistics_(nullptr)
+			, fast_math_(false)
+			, quick_anonymous_(false)
+			, jit_symbols_(false)
 		{
 		}
 		~MCJIT_helper();
 
 		llvm::Function * get_function(const std::string & name);
+		llvm::Function * find_definition(const std::string & name) const;
 		llvm::Module * get_module_for_new_function();
+		llvm::Module * get_module_for_anonymous_function();
 		void * get_pointer_to_function(llvm::Function * function);
 		void * get_symbol_address(const std::string & name);
+		uint64_t resolve_symbol(const std::string & name);
+		void load_library(const std::string & path);
+		void release_function(llvm::Function * function);
+
+		std::size_t get_resident_memory() const
+		{
+			return resident_memory_;
+		}
+
+		const slab_statistics & get_memory_statistics() const
+		{
+			return resident_slabs_.get_statistics();
+		}
+
+		void set_statistics(compile_statistics * statistics)
+		{
+			statistics_ = statistics;
+		}
+
+		void enable_jit_symbols();
+		void enable_debug_info(const std::string & source_name);
+
+		debug_info * get_debug_info() const
+		{
+			return debug_info_.get();
+		}
+
+		//relaxes IEEE semantics for every function, and lets the backend fuse multiply-adds
+		void enable_fast_math()
+		{
+			fast_math_ = true;
+		}
+
+		bool is_fast_math() const
+		{
+			return fast_math_;
+		}
+
+		//anonymous functions without loops get only mem2reg and the fast instruction selector, which is what a REPL wants:
+		//such an expression runs once and briefly, and the definitions it calls keep the full pipeline
+		void enable_quick_anonymous()
+		{
+			quick_anonymous_ = true;
+		}
+
+		string_object * intern_string(const std::string & value);
+		llvm::Constant * get_string_literal(const std::string & value);
 
 		static std::string generate_function_name(const std::string & name);
 	};
 
 	class HelpingMemoryManager :
-		public llvm::SectionMemoryManager
+		public llvm::RTDyldMemoryManager
 	{
 		MCJIT_helper * helper_;
+		slab_allocator & allocator_;
+		std::vector<std::tuple<section_categories, uint8_t *, std::size_t>> sections_;
+		std::size_t allocated_;
+		std::size_t code_size_;
 	public:
 		HelpingMemoryManager(const HelpingMemoryManager &) = delete;
 		HelpingMemoryManager & operator=(const HelpingMemoryManager &) = delete;
 
-		HelpingMemoryManager(MCJIT_helper * helper)
+		HelpingMemoryManager(MCJIT_helper * helper, slab_allocator & allocator)
 			: helper_(helper)
+			, allocator_(allocator)
+			, allocated_(0)
+			, code_size_(0)
 		{
 		}
+		~HelpingMemoryManager();
 
+		std::size_t get_code_size() const
+		{
+			return code_size_;
+		}
+
+		uint8_t * allocateCodeSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name) override;
+		uint8_t * allocateDataSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name, bool is_read_only) override;
+		bool finalizeMemory(std::string * error_str) override;
 		uint64_t getSymbolAddress(const std::string & name) override;
 	};
+
+	//writes /tmp/perf-<pid>.map, so that perf can name the functions of every object that stays loaded;
+	//the file belongs to the process, so the JIT sessions of all parsers and engines append to it through one listener
+	class PerfMapEventListener :
+		public llvm::JITEventListener
+	{
+		std::mutex mutex_;
+		std::ofstream map_;
+
+		PerfMapEventListener();
+	public:
+		PerfMapEventListener(const PerfMapEventListener &) = delete;
+		PerfMapEventListener & operator=(const PerfMapEventListener &) = delete;
+
+		static PerfMapEventListener & get();
+
+		void NotifyObjectEmitted(const llvm::object::ObjectFile & object, const llvm::RuntimeDyld::LoadedObjectInfo & info) override;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace summer_lang
+{
+	static const std::int64_t warmup_ns = 100000000;
+	static const std::int64_t sample_ns = 1000;
+	static const std::int64_t default_ns = 1000000000;
+	static const std::int64_t max_samples = 100000;
+	static const std::int64_t warmup_share = 10;		//an explicit count is warmed up by at most a tenth of its calls
+
+	//results of the measured calls end up here, so the work can not be optimized away
+	static volatile double sink;
+
+	std::int64_t benchmark::now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	std::uint64_t benchmark::cycles()
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return static_cast<std::uint64_t>(now_ns());
+#endif
+	}
+
+	benchmark::result benchmark::run(bench_body body, void * env, std::int64_t iterations)
+	{
+		//warm up caches and branch predictors, and estimate the time of one call
+		auto total = 0.0;
+		auto max_warmup_calls = iterations ? std::max<std::int64_t>(1, iterations / warmup_share) : 0;
+		std::int64_t warmup_calls = 0;
+		auto start = now_ns();
+		auto elapsed = std::int64_t(0);
+		do
+		{
+			total += body(env);
+			++warmup_calls;
+			elapsed = now_ns() - start;
+		} while (elapsed < warmup_ns && (!max_warmup_calls || warmup_calls < max_warmup_calls));
+		auto call_ns = std::max(1.0, static_cast<double>(elapsed) / warmup_calls);
+
+		auto batch = std::max<std::int64_t>(1, static_cast<std::int64_t>(sample_ns / call_ns + 1));
+		std::int64_t samples;
+		if (iterations)
+		{
+			//a large count grows the batches instead of the samples, whose times are all kept
+			batch = std::max(std::min(batch, iterations), (iterations + max_samples - 1) / max_samples);
+			samples = (iterations + batch - 1) / batch;
+		}
+		else
+		{
+			//the budget bounds the sample count, so a slow call gets fewer samples rather than a longer run
+			samples = std::min(max_samples, std::max<std::int64_t>(1, static_cast<std::int64_t>(default_ns / (call_ns * batch))));
+		}
+
+		std::vector<double> per_call;
+		per_call.reserve(static_cast<std::size_t>(samples));
+		std::int64_t measured_ns = 0, measured_calls = 0;
+		for (std::int64_t i = 0; i != samples; ++i)
+		{
+			auto calls = iterations ? std::min(batch, iterations - measured_calls) : batch;
+			auto sample_start = now_ns();
+			for (std::int64_t j = 0; j != calls; ++j)
+				total += body(env);
+			auto sample_time = now_ns() - sample_start;
+
+			per_call.push_back(static_cast<double>(sample_time) / calls);
+			measured_ns += sample_time;
+			measured_calls += calls;
+		}
+		sink = total;
+
+		std::sort(per_call.begin(), per_call.end());
+		result r;
+		r.mean_ns = static_cast<double>(measured_ns) / measured_calls;
+		r.median_ns = per_call[per_call.size() / 2];
+		r.p99_ns = per_call[std::min(per_call.size() - 1, per_call.size() * 99 / 100)];
+		r.iterations = measured_calls;
+		return r;
+	}
+}
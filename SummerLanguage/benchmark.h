@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace summer_lang
+{
+	//a call measured by 'bench', made through the same kind of thunk as 'spawn'
+	typedef double(*bench_body)(void * env);
+
+	//Times a call for 'bench': after a warmup the calls are grouped into samples of at least a microsecond,
+	//so the clock is cheap against the work, and the statistics are taken over the time per call of each sample.
+	class benchmark
+	{
+	public:
+		struct result
+		{
+			double mean_ns, median_ns, p99_ns;
+			std::int64_t iterations;
+		};
+
+		//monotonic, in nanoseconds since an arbitrary point
+		static std::int64_t now_ns();
+		//the time stamp counter where the processor has one, otherwise the clock
+		static std::uint64_t cycles();
+
+		//'iterations' of 0 runs for about a second; either way at most 100000 samples are taken
+		static result run(bench_body body, void * env, std::int64_t iterations);
+	};
+}
@@ -0,0 +1,79 @@
+#include "debug_info.h"
+#include <llvm\Support\Dwarf.h>
+#include <llvm\Support\Path.h>
+
+namespace summer_lang
+{
+	debug_info::debug_info(const std::string & source_name)
+		: file_name_(llvm::sys::path::filename(source_name))
+		, directory_(llvm::sys::path::parent_path(source_name))
+		, compile_unit_(nullptr)
+		, file_(nullptr)
+	{
+		if (directory_.empty())
+			directory_ = ".";
+	}
+
+	void debug_info::begin_module(llvm::Module * module)
+	{
+		module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+
+		builder_ = std::make_unique<llvm::DIBuilder>(*module);
+		compile_unit_ = builder_->createCompileUnit(llvm::dwarf::DW_LANG_C, file_name_, directory_, "Summer Language", false, "", 0);
+		file_ = builder_->createFile(file_name_, directory_);
+		scopes_.clear();
+	}
+
+	void debug_info::finish_module()
+	{
+		if (!builder_)
+			return;
+
+		builder_->finalize();
+		builder_.reset();
+		compile_unit_ = nullptr;
+		file_ = nullptr;
+	}
+
+	llvm::DIType * debug_info::get_type_(llvm::Type * type)
+	{
+		if (type->isDoubleTy())
+			return builder_->createBasicType("number", 64, 64, llvm::dwarf::DW_ATE_float);
+		if (type == llvm::Type::getInt8PtrTy(type->getContext()))
+			return builder_->createBasicType("string", sizeof(void *) * 8, sizeof(void *) * 8, llvm::dwarf::DW_ATE_address);
+		if (type->isPointerTy() && type->getPointerElementType()->isStructTy() && type->getPointerElementType()->getStructName() == "summer.future")
+			return builder_->createBasicType("future", sizeof(void *) * 8, sizeof(void *) * 8, llvm::dwarf::DW_ATE_address);
+		if (type->isPointerTy())
+			return builder_->createBasicType("array", sizeof(void *) * 8, sizeof(void *) * 8, llvm::dwarf::DW_ATE_address);
+		return nullptr;
+	}
+
+	void debug_info::begin_function(llvm::Function * function, const std::string & name, int row_no)
+	{
+		if (!builder_)
+			return;
+
+		std::vector<llvm::Metadata *> types{ get_type_(function->getReturnType()) };
+		for (auto & arg : function->args())
+			types.push_back(get_type_(arg.getType()));
+
+		auto function_type = builder_->createSubroutineType(file_, builder_->getOrCreateTypeArray(types));
+		auto subprogram = builder_->createFunction(file_, name, function->getName(), file_, row_no, function_type,
+			false, true, row_no, 0, false, function);
+		scopes_.push_back(subprogram);
+	}
+
+	void debug_info::end_function(llvm::IRBuilder<> & builder)
+	{
+		if (!scopes_.empty())
+			scopes_.pop_back();
+		builder.SetCurrentDebugLocation(llvm::DebugLoc());
+	}
+
+	void debug_info::emit_location(llvm::IRBuilder<> & builder, int row_no)
+	{
+		if (scopes_.empty())
+			return;
+		builder.SetCurrentDebugLocation(llvm::DebugLoc::get(row_no, 0, scopes_.back()));
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <llvm\IR\DIBuilder.h>
+#include <llvm\IR\DebugInfo.h>
+#include <llvm\IR\IRBuilder.h>
+#include <llvm\IR\Module.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace summer_lang
+{
+	//Emits a DWARF line table for the functions of one source file.
+	//Every JIT module gets its own compile unit, which is finished right before the module is compiled.
+	class debug_info
+	{
+		std::string file_name_;
+		std::string directory_;
+		std::unique_ptr<llvm::DIBuilder> builder_;
+		llvm::DICompileUnit * compile_unit_;
+		llvm::DIFile * file_;
+		std::vector<llvm::DIScope *> scopes_;
+
+		llvm::DIType * get_type_(llvm::Type * type);
+	public:
+		debug_info(const debug_info &) = delete;
+		debug_info & operator=(const debug_info &) = delete;
+
+		debug_info(const std::string & source_name);
+
+		void begin_module(llvm::Module * module);
+		void finish_module();
+
+		void begin_function(llvm::Function * function, const std::string & name, int row_no);
+		void end_function(llvm::IRBuilder<> & builder);
+		void emit_location(llvm::IRBuilder<> & builder, int row_no);
+	};
+}
@@ -0,0 +1,92 @@
+#include "engine.h"
+#include "parser.h"
+#include <sstream>
+
+namespace summer_lang
+{
+	static bool has_category(llvm::Type * type, value_categories category)
+	{
+		switch (category)
+		{
+		case value_categories::VOID:
+			return type->isVoidTy();
+		case value_categories::NUMBER:
+			return type->isDoubleTy();
+		}
+		return false;
+	}
+
+	engine::call_scope::~call_scope()
+	{
+		lib::await_all();
+	}
+
+	engine::engine()
+		: parser_(std::make_unique<parser>())
+	{
+	}
+
+	engine::~engine()
+	{
+	}
+
+	void engine::load(const std::string & source)
+	{
+		std::istringstream source_code(source);
+		try
+		{
+			parser_->parse(source_code);
+		}
+		catch (...)
+		{
+			lib::flush();
+			throw;
+		}
+		lib::flush();
+	}
+
+	void engine::load(const char * source, std::size_t size)
+	{
+		load(std::string(source, size));
+	}
+
+	void engine::load_file(const std::string & path)
+	{
+		try
+		{
+			parser_->parse(path);
+		}
+		catch (...)
+		{
+			lib::flush();
+			throw;
+		}
+		lib::flush();
+	}
+
+	void engine::load_library(const std::string & path)
+	{
+		parser_->load_library(path);
+	}
+
+	void engine::enable_fast_math()
+	{
+		parser_->enable_fast_math();
+	}
+
+	void * engine::get_function_address_(const std::string & name, const std::vector<value_categories> & signature)
+	{
+		auto function = parser_->find_function(name);
+		if (!function)
+			throw std::exception(("No function named " + name + " has been loaded").c_str());
+
+		auto type = function->getFunctionType();
+		auto matches = type->getNumParams() + 1 == signature.size() && has_category(type->getReturnType(), signature[0]);
+		for (unsigned i = 0; matches && i != type->getNumParams(); ++i)
+			matches = has_category(type->getParamType(i), signature[i + 1]);
+		if (!matches)
+			throw std::exception(("Function " + name + " does not have the requested signature").c_str());
+
+		return parser_->get_function_address(function);
+	}
+}
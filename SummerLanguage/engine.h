@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace summer_lang
+{
+	class parser;
+
+	//the Summer types a host can pass to, and get back from, a compiled function
+	enum class value_categories
+	{
+		VOID,
+		NUMBER
+	};
+
+	template <typename T>
+	struct value_category;
+
+	template <>
+	struct value_category<void>
+	{
+		static const value_categories value = value_categories::VOID;
+	};
+
+	template <>
+	struct value_category<double>
+	{
+		static const value_categories value = value_categories::NUMBER;
+	};
+
+	//the return type comes first, then the parameters
+	template <typename Signature>
+	struct signature_of;
+
+	template <typename R, typename... Args>
+	struct signature_of<R(Args...)>
+	{
+		static std::vector<value_categories> get()
+		{
+			return{ value_category<R>::value, value_category<Args>::value... };
+		}
+	};
+
+	//Embeds Summer in a host program: source is compiled once, and the functions it defines are
+	//then called through native pointers, without any parsing or JIT work on the calling path.
+	//	engine e;
+	//	e.load("function add(x: number, y: number)->number begin return x + y end");
+	//	auto add = e.get_function<double(double, double)>("add");
+	//	{
+	//		engine::call_scope scope;
+	//		add(1, 2);
+	//	}
+	//Functions stay valid as long as the engine, and may be called from any thread.
+	//Every engine has its own LLVM context and JIT session, so engines on different threads compile and run
+	//independently, but one engine must only be loaded from one thread at a time.
+	class engine
+	{
+		std::unique_ptr<parser> parser_;
+
+		void * get_function_address_(const std::string & name, const std::vector<value_categories> & signature);
+	public:
+		//Calls started by 'spawn' under a function the host called belong to the calling thread, and so do the arrays it creates.
+		//When a scope ends it waits for the calls and frees both, so calls that may spawn or create arrays must be made inside one;
+		//one scope may cover any number of calls.
+		class call_scope
+		{
+		public:
+			call_scope(const call_scope &) = delete;
+			call_scope & operator=(const call_scope &) = delete;
+
+			call_scope()
+			{
+			}
+			~call_scope();
+		};
+
+		engine(const engine &) = delete;
+		engine & operator=(const engine &) = delete;
+
+		engine();
+		~engine();
+
+		//definitions are kept, top-level expressions run while loading
+		void load(const std::string & source);
+		void load(const char * source, std::size_t size);
+		void load_file(const std::string & path);
+		void load_library(const std::string & path);
+		void enable_fast_math();
+
+		//throws when no function of that name was loaded, or its prototype differs from 'Signature'
+		template <typename Signature>
+		Signature * get_function(const std::string & name)
+		{
+			return reinterpret_cast<Signature *>(get_function_address_(name, signature_of<Signature>::get()));
+		}
+	};
+}
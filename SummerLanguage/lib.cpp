@@ -0,0 +1,659 @@
+#include "lib.h"
+#include "output_buffer.h"
+#include "region_allocator.h"
+#include "thread_pool.h"
+#include "mapped_file.h"
+#include "benchmark.h"
+#include <algorithm>
+#include <new>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+namespace summer_lang
+{
+	void lib::import()
+	{
+		LLVMAddSymbol("print_number", &lib::print_number);
+		LLVMAddSymbol("print_string", &lib::print_string);
+		LLVMAddSymbol("flush", &lib::flush);
+		LLVMAddSymbol("echo_number", &lib::echo_number);
+		LLVMAddSymbol("echo_string", &lib::echo_string);
+		LLVMAddSymbol("open_file", &lib::open_file);
+		LLVMAddSymbol("close_file", &lib::close_file);
+		LLVMAddSymbol("end_of_file", &lib::end_of_file);
+		LLVMAddSymbol("end_of_line", &lib::end_of_line);
+		LLVMAddSymbol("read_line", &lib::read_line);
+		LLVMAddSymbol("read_field", &lib::read_field);
+		LLVMAddSymbol("read_number", &lib::read_number);
+		LLVMAddSymbol("str_cat", &lib::str_cat);
+		LLVMAddSymbol("str_append", &lib::str_append);
+		LLVMAddSymbol("str_equal", &lib::str_equal);
+		LLVMAddSymbol("str_retain", &lib::str_retain);
+		LLVMAddSymbol("str_release", &lib::str_release);
+		LLVMAddSymbol("array", &lib::array_new);
+		LLVMAddSymbol("array_out_of_bounds", &lib::array_out_of_bounds);
+		LLVMAddSymbol("parallel_for", &lib::parallel_for);
+		LLVMAddSymbol("parallel_reduce", &lib::parallel_reduce);
+		LLVMAddSymbol("spawn", &lib::spawn);
+		LLVMAddSymbol("await", &lib::await);
+		LLVMAddSymbol("clock_ns", &lib::clock_ns);
+		LLVMAddSymbol("cycle_count", &lib::cycle_count);
+		LLVMAddSymbol("bench", &lib::bench);
+
+		//targets of the math intrinsics that the backend does not expand inline,
+		//a function of the program with the same name is resolved before them
+		typedef double(*unary_function)(double);
+		typedef double(*binary_function)(double, double);
+		LLVMAddSymbol("sin", static_cast<unary_function>(&std::sin));
+		LLVMAddSymbol("cos", static_cast<unary_function>(&std::cos));
+		LLVMAddSymbol("exp", static_cast<unary_function>(&std::exp));
+		LLVMAddSymbol("exp2", static_cast<unary_function>(&std::exp2));
+		LLVMAddSymbol("log", static_cast<unary_function>(&std::log));
+		LLVMAddSymbol("log2", static_cast<unary_function>(&std::log2));
+		LLVMAddSymbol("log10", static_cast<unary_function>(&std::log10));
+		LLVMAddSymbol("sqrt", static_cast<unary_function>(&std::sqrt));
+		LLVMAddSymbol("fabs", static_cast<unary_function>(&std::fabs));
+		LLVMAddSymbol("floor", static_cast<unary_function>(&std::floor));
+		LLVMAddSymbol("ceil", static_cast<unary_function>(&std::ceil));
+		LLVMAddSymbol("trunc", static_cast<unary_function>(&std::trunc));
+		LLVMAddSymbol("round", static_cast<unary_function>(&std::round));
+		LLVMAddSymbol("rint", static_cast<unary_function>(&std::rint));
+		LLVMAddSymbol("pow", static_cast<binary_function>(&std::pow));
+		LLVMAddSymbol("fmin", static_cast<binary_function>(&std::fmin));
+		LLVMAddSymbol("fmax", static_cast<binary_function>(&std::fmax));
+		LLVMAddSymbol("copysign", static_cast<binary_function>(&std::copysign));
+		LLVMAddSymbol("fma", static_cast<double(*)(double, double, double)>(&std::fma));
+	}
+
+	//objects created while a top-level expression runs on its own thread come from its region and are freed in bulk when it returns;
+	//arrays created outside of a region go to the future group instead, see array_new
+	void lib::enter_region()
+	{
+		region_allocator::get_current().enter();
+	}
+
+	void lib::leave_region()
+	{
+		region_allocator::get_current().leave();
+	}
+
+	//regions belong to threads, a string of the region of another thread gets its new buffer from the heap
+	static char * allocate_buffer(string_object * str, std::size_t capacity)
+	{
+		auto & region = region_allocator::get_current();
+		if ((str->flags & string_object::in_region) && region.is_active())
+		{
+			if (auto buffer = static_cast<char *>(region.allocate(capacity + 1, 1)))
+			{
+				str->flags |= string_object::buffer_in_region;
+				return buffer;
+			}
+		}
+		str->flags &= ~string_object::buffer_in_region;
+		return new char[capacity + 1];
+	}
+
+	static void free_buffer(string_object * str)
+	{
+		if (str->data == str->inline_data || (str->flags & string_object::view))
+			return;
+		if (str->flags & string_object::buffer_in_region)
+			region_allocator::get_current().deallocate(str->data, str->capacity + 1);
+		else
+			delete[] str->data;
+	}
+
+	//the new string is owned by the caller, its reference count is 1
+	string_object * lib::make_string(const char * str, std::size_t length, std::size_t capacity)
+	{
+		auto & region = region_allocator::get_current();
+		auto memory = region.is_active() ? region.allocate(sizeof(string_object)) : nullptr;
+		string_object * result;
+		if (memory)
+		{
+			result = new (memory) string_object;
+			result->flags = string_object::in_region;
+		}
+		else
+		{
+			result = new string_object;
+			result->flags = 0;
+		}
+
+		result->ref_count = 1;
+		result->length = length;
+		result->capacity = std::max(capacity, string_object::inline_capacity);
+		result->data = result->capacity == string_object::inline_capacity ? result->inline_data : allocate_buffer(result, result->capacity);
+		std::memcpy(result->data, str, length);
+		result->data[length] = '\0';
+		return result;
+	}
+
+	string_object * lib::make_literal(const std::string & str)
+	{
+		auto result = make_string(str.data(), str.size(), str.size());
+		result->ref_count = string_object::immortal;
+		return result;
+	}
+
+	static void release_file(input_file * input);
+
+	void lib::destroy_string(string_object * str)
+	{
+		free_buffer(str);
+		if (str->flags & string_object::view)
+			release_file(str->file);
+		if (str->flags & string_object::in_region)
+		{
+			str->~string_object();
+			region_allocator::get_current().deallocate(str, sizeof(string_object));
+		}
+		else
+			delete str;
+	}
+
+	void lib::print_number(double d)
+	{
+		output_buffer::get_stdout().write_number(d);
+	}
+
+	void lib::print_string(string_object * s)
+	{
+		if (s)
+			output_buffer::get_stdout().write(s->data, s->length);
+	}
+
+	void lib::flush()
+	{
+		output_buffer::get_stdout().flush();
+	}
+
+	//values of top-level expressions in the REPL
+	void lib::echo_number(double d)
+	{
+		auto & output = output_buffer::get_stdout();
+		output.write("= ", 2);
+		output.write_number(d);
+		output.write("\n", 1);
+	}
+
+	void lib::echo_string(string_object * s)
+	{
+		auto & output = output_buffer::get_stdout();
+		output.write("= \"", 3);
+		print_string(s);
+		output.write("\"\n", 2);
+	}
+
+	//referenced by the table of open files and by every view object, the mapping goes with the last of them
+	struct input_file
+	{
+		mapped_file file;
+		string_object * view;		//the file keeps a reference to the last piece it returned
+		std::atomic<std::int32_t> ref_count;
+	};
+
+	static void release_file(input_file * input)
+	{
+		if (--input->ref_count == 0)
+			delete input;
+	}
+
+	//files are numbered by their index, closed slots are reused
+	static std::mutex files_mutex;
+	static std::vector<input_file *> files;
+
+	//a reference to an open file, taken under the lock so that a close_file on another thread can not free it while it is read
+	class file_reference
+	{
+		input_file * input_;
+	public:
+		file_reference(const file_reference &) = delete;
+		file_reference & operator=(const file_reference &) = delete;
+
+		explicit file_reference(input_file * input)
+			: input_(input)
+		{
+		}
+
+		file_reference(file_reference && other)
+			: input_(other.input_)
+		{
+			other.input_ = nullptr;
+		}
+
+		~file_reference()
+		{
+			if (input_)
+				release_file(input_);
+		}
+
+		input_file * operator->() const
+		{
+			return input_;
+		}
+
+		input_file & operator*() const
+		{
+			return *input_;
+		}
+
+		explicit operator bool() const
+		{
+			return input_ != nullptr;
+		}
+	};
+
+	static file_reference find_file(double file)
+	{
+		std::lock_guard<std::mutex> lock(files_mutex);
+		auto index = static_cast<std::size_t>(file);
+		if (!(file >= 0) || index >= files.size() || !files[index])
+			return file_reference(nullptr);
+		++files[index]->ref_count;
+		return file_reference(files[index]);
+	}
+
+	//once the script has let go of the previous piece, its object is reused, so walking a file allocates nothing
+	static string_object * make_view(input_file & input, const char * begin, std::size_t length)
+	{
+		if (!input.view || input.view->ref_count != 1)
+		{
+			lib::str_release(input.view);
+			input.view = new string_object;
+			input.view->ref_count = 1;
+			input.view->flags = string_object::view;
+			input.view->file = &input;
+			++input.ref_count;
+		}
+
+		input.view->data = const_cast<char *>(begin);
+		input.view->length = length;
+		input.view->capacity = length;
+		return lib::str_retain(input.view);
+	}
+
+	static char get_separator(string_object * separator)
+	{
+		return separator && separator->length ? separator->data[0] : '\0';
+	}
+
+	//the whole field, apart from surrounding spaces, must be a number, otherwise the result is NaN
+	static double parse_number(const char * begin, std::size_t length)
+	{
+		auto end = begin + length;
+		while (begin != end && (*begin == ' ' || *begin == '\t'))
+			++begin;
+		while (end != begin && (end[-1] == ' ' || end[-1] == '\t'))
+			--end;
+
+		double value;
+#if defined(__cpp_lib_to_chars)
+		auto result = std::from_chars(begin, end, value);
+		if (begin == end || result.ec != std::errc() || result.ptr != end)
+			return std::numeric_limits<double>::quiet_NaN();
+#else
+		char digits[64];
+		auto count = static_cast<std::size_t>(end - begin);
+		if (!count || count >= sizeof(digits))
+			return std::numeric_limits<double>::quiet_NaN();
+		std::memcpy(digits, begin, count);
+		digits[count] = '\0';
+
+		char * digits_end;
+		value = std::strtod(digits, &digits_end);
+		if (digits_end != digits + count)
+			return std::numeric_limits<double>::quiet_NaN();
+#endif
+		return value;
+	}
+
+	//the result is the number of the file, or -1 when it can not be opened
+	double lib::open_file(string_object * path)
+	{
+		auto input = std::make_unique<input_file>();
+		input->view = nullptr;
+		input->ref_count = 1;
+		if (!input->file.open(path ? std::string(path->data, path->length) : std::string()))
+			return -1;
+
+		std::lock_guard<std::mutex> lock(files_mutex);
+		auto slot = std::find(files.begin(), files.end(), nullptr);
+		if (slot == files.end())
+			slot = files.insert(files.end(), nullptr);
+		*slot = input.release();
+		return static_cast<double>(slot - files.begin());
+	}
+
+	//strings read from the file point into its mapping, which stays until the last of them is released
+	void lib::close_file(double file)
+	{
+		input_file * input;
+		{
+			std::lock_guard<std::mutex> lock(files_mutex);
+			auto index = static_cast<std::size_t>(file);
+			if (!(file >= 0) || index >= files.size())
+				return;
+			input = files[index];
+			files[index] = nullptr;
+		}
+		if (input)
+		{
+			str_release(input->view);
+			release_file(input);
+		}
+	}
+
+	double lib::end_of_file(double file)
+	{
+		auto input = find_file(file);
+		return !input || input->file.at_end() ? 1.0 : 0.0;
+	}
+
+	//a script reads a record field by field until end_of_line, the next read_field or read_number then starts on the
+	//next line, so a loop reading a fixed number of fields per line runs until end_of_file without reading the line breaks
+	double lib::end_of_line(double file)
+	{
+		auto input = find_file(file);
+		return !input || input->file.at_line_end() ? 1.0 : 0.0;
+	}
+
+	string_object * lib::read_line(double file)
+	{
+		const char * begin;
+		std::size_t length;
+		auto input = find_file(file);
+		if (!input || !input->file.next_line(begin, length))
+			return nullptr;
+		return make_view(*input, begin, length);
+	}
+
+	string_object * lib::read_field(double file, string_object * separator)
+	{
+		const char * begin;
+		std::size_t length;
+		auto input = find_file(file);
+		if (!input || !input->file.next_field(get_separator(separator), begin, length))
+			return nullptr;
+		return make_view(*input, begin, length);
+	}
+
+	double lib::read_number(double file, string_object * separator)
+	{
+		const char * begin;
+		std::size_t length;
+		auto input = find_file(file);
+		if (!input || !input->file.next_field(get_separator(separator), begin, length))
+			return std::numeric_limits<double>::quiet_NaN();
+		return parse_number(begin, length);
+	}
+
+	string_object * lib::str_cat(string_object * left, string_object * right)
+	{
+		auto left_length = left ? left->length : 0;
+		auto right_length = right ? right->length : 0;
+
+		auto result = make_string(left ? left->data : "", left_length, left_length + right_length);
+		if (right_length)
+			std::memcpy(result->data + left_length, right->data, right_length);
+		result->length = left_length + right_length;
+		result->data[result->length] = '\0';
+		return result;
+	}
+
+	//takes over the caller's reference to 'dest' and returns the reference to the result
+	//'dest' is extended in place when that reference is the only one, growing its buffer geometrically
+	string_object * lib::str_append(string_object * dest, string_object * piece)
+	{
+		auto piece_length = piece ? piece->length : 0;
+		if (!piece_length)
+			return dest;
+		if (!dest)
+			return make_string(piece->data, piece_length, piece_length);
+
+		auto length = dest->length + piece_length;
+		if (dest->ref_count != 1 || (dest->flags & string_object::view))
+		{
+			auto result = make_string(dest->data, dest->length, 2 * length);
+			std::memcpy(result->data + dest->length, piece->data, piece_length);
+			result->length = length;
+			result->data[length] = '\0';
+			str_release(dest);
+			return result;
+		}
+
+		if (length > dest->capacity)
+		{
+			auto capacity = std::max(2 * dest->capacity, length);
+			auto data = allocate_buffer(dest, capacity);
+			std::memcpy(data, dest->data, dest->length);
+			std::memcpy(data + dest->length, piece->data, piece_length);		//'piece' may be 'dest' itself
+			free_buffer(dest);
+			dest->data = data;
+			dest->capacity = capacity;
+		}
+		else
+			std::memcpy(dest->data + dest->length, piece->data, piece_length);
+
+		dest->length = length;
+		dest->data[length] = '\0';
+		return dest;
+	}
+
+	int lib::str_equal(string_object * left, string_object * right)
+	{
+		if (left == right)
+			return 1;
+
+		auto left_length = left ? left->length : 0;
+		auto right_length = right ? right->length : 0;
+		return left_length == right_length && (!left_length || std::memcmp(left->data, right->data, left_length) == 0);
+	}
+
+	string_object * lib::str_retain(string_object * str)
+	{
+		if (str && str->ref_count != string_object::immortal)
+			++str->ref_count;
+		return str;
+	}
+
+	void lib::str_release(string_object * str)
+	{
+		if (str && str->ref_count != string_object::immortal && --str->ref_count == 0)
+			destroy_string(str);
+	}
+
+	//errors of the running program may be raised on a worker of the thread pool, which std::exit would try to join,
+	//so the process ends without running static destructors once the output is written
+	static void runtime_error(const std::string & message)
+	{
+		lib::flush();
+		std::cerr << message << std::endl;
+		std::_Exit(EXIT_FAILURE);
+	}
+
+	//futures live until the top-level expression that spawned them, directly or not, has returned;
+	//top-level expressions of different engines run at the same time, so each has its own group
+	struct future_group
+	{
+		std::mutex mutex;
+		std::vector<future_object *> futures;
+		std::vector<void *> arrays;		//heap memory of the arrays created outside of a region
+	};
+
+	struct future_object
+	{
+		thread_pool::job * task;
+		void * env;
+	};
+
+	//a thread spawns into its own group; loops and spawned calls it starts carry the group to the workers,
+	//so whatever they spawn is awaited by the same top-level expression.
+	//The group is installed before a job is started, since jobs take it from their starting thread.
+	static thread_local future_group thread_futures;
+
+	static future_group & current_futures()
+	{
+		auto group = static_cast<future_group *>(thread_pool::get_group());
+		if (!group)
+		{
+			group = &thread_futures;
+			thread_pool::set_group(group);
+		}
+		return *group;
+	}
+
+	//the count is computed from the bounds of the loop, which may be any number
+	static std::int64_t trip_count(double count)
+	{
+		if (!(count < 9223372036854775808.0))
+			runtime_error("\'parallel for\' of " + std::to_string(count) + " iterations is too long");
+		return count > 0 ? static_cast<std::int64_t>(count) : 0;
+	}
+
+	void lib::parallel_for(void * body, void * env, double count)
+	{
+		current_futures();
+		thread_pool::get().parallel_for(reinterpret_cast<parallel_body>(body), env, trip_count(count));
+	}
+
+	double lib::parallel_reduce(void * body, std::int64_t op, void * env, double count)
+	{
+		current_futures();
+		return thread_pool::get().parallel_reduce(reinterpret_cast<reduction_body>(body), static_cast<reduction_categories>(op), env, trip_count(count));
+	}
+
+	//the arguments in 'env' are copied, since the spawning function may return before the call starts
+	future_object * lib::spawn(void * body, void * env, std::int64_t size)
+	{
+		auto & group = current_futures();
+		auto future = new future_object;
+		future->env = std::malloc(static_cast<std::size_t>(size));
+		std::memcpy(future->env, env, static_cast<std::size_t>(size));
+		future->task = thread_pool::get().spawn(reinterpret_cast<spawn_body>(body), future->env);
+
+		std::lock_guard<std::mutex> lock(group.mutex);
+		group.futures.push_back(future);
+		return future;
+	}
+
+	double lib::await(future_object * future)
+	{
+		return thread_pool::get().wait(*future->task);
+	}
+
+	//a spawned call may still hold a future of an earlier one, so nothing is freed before every call has finished
+	void lib::await_all()
+	{
+		auto & group = current_futures();
+		std::vector<future_object *> finished;
+		while (true)
+		{
+			std::vector<future_object *> pending;
+			{
+				std::lock_guard<std::mutex> lock(group.mutex);
+				pending.swap(group.futures);
+			}
+			if (pending.empty())
+				break;
+
+			for (auto future : pending)
+				await(future);
+			finished.insert(finished.end(), pending.begin(), pending.end());
+		}
+
+		for (auto future : finished)
+		{
+			delete future->task;
+			std::free(future->env);
+			delete future;
+		}
+
+		std::vector<void *> arrays;
+		{
+			std::lock_guard<std::mutex> lock(group.mutex);
+			arrays.swap(group.arrays);
+		}
+		for (auto memory : arrays)
+			std::free(memory);
+	}
+
+	double lib::clock_ns()
+	{
+		return static_cast<double>(benchmark::now_ns());
+	}
+
+	double lib::cycle_count()
+	{
+		return static_cast<double>(benchmark::cycles());
+	}
+
+	//prints the statistics of the measured call, the result is its mean time
+	double lib::bench(void * body, void * env, double iterations, string_object * name)
+	{
+		auto result = benchmark::run(reinterpret_cast<bench_body>(body), env, iterations > 0 ? static_cast<std::int64_t>(iterations) : 0);
+
+		char report[256];
+		auto length = std::snprintf(report, sizeof(report), "bench %.*s: mean %.1f ns/op, median %.1f ns/op, p99 %.1f ns/op, %lld iterations\n",
+			name ? static_cast<int>(std::min<std::size_t>(name->length, 128)) : 0, name ? name->data : "",
+			result.mean_ns, result.median_ns, result.p99_ns, static_cast<long long>(result.iterations));
+		output_buffer::get_stdout().write(report, static_cast<std::size_t>(std::min<int>(length, sizeof(report) - 1)));
+		return result.mean_ns;
+	}
+
+	array_object * lib::array_new(double length)
+	{
+		//the header, and the padding to the first element, must fit next to the elements in a size_t
+		static const double max_count = static_cast<double>((SIZE_MAX - 128) / sizeof(double));
+		if (length > max_count)
+			runtime_error("Array of " + std::to_string(length) + " elements is too large");
+		auto count = length > 0 ? static_cast<std::int64_t>(length) : 0;
+		auto & region = region_allocator::get_current();
+		if (region.is_active())
+		{
+			//an exhausted region falls back to the heap, the header left behind goes with the region
+			auto result = static_cast<array_object *>(region.allocate(sizeof(array_object)));
+			auto data = result ? static_cast<double *>(region.allocate(count * sizeof(double), array_alignment)) : nullptr;
+			if (data)
+			{
+				std::memset(data, 0, count * sizeof(double));
+				result->data = data;
+				result->length = count;
+				return result;
+			}
+		}
+
+		//workers of the thread pool and host calls have no region, their arrays are freed with the futures of the
+		//top-level expression or engine::call_scope they run under, which have the same lifetime as a region
+		auto memory = static_cast<char *>(std::calloc(1, sizeof(array_object) + array_alignment + count * sizeof(double)));
+		if (!memory)
+			runtime_error("Out of memory allocating an array of " + std::to_string(count) + " elements");
+		{
+			auto & group = current_futures();
+			std::lock_guard<std::mutex> lock(group.mutex);
+			group.arrays.push_back(memory);
+		}
+		auto result = reinterpret_cast<array_object *>(memory);
+
+		//elements start on a cache line, so vectorized loops get aligned accesses
+		auto data = memory + sizeof(array_object);
+		data += (array_alignment - reinterpret_cast<std::uintptr_t>(data) % array_alignment) % array_alignment;
+		result->data = reinterpret_cast<double *>(data);
+		result->length = count;
+		return result;
+	}
+
+	void lib::array_out_of_bounds(std::int64_t index, std::int64_t length)
+	{
+		runtime_error("Array index " + std::to_string(index) + " is out of bounds [0, " + std::to_string(length) + ")");
+	}
+}
@@ -1,43 +1,91 @@
 #pragma once
 #include <iostream>
 #include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <string>
 #include <llvm-c\Support.h>
 
 namespace summer_lang
 {
+	//layout of 'number[]' values, codegen addresses the fields as { double*, i64 }
+	struct array_object
+	{
+		double * data;
+		std::int64_t length;
+	};
+
+	//an open input file, see lib::open_file
+	struct input_file;
+
+	//runtime representation of 'string' values, codegen only passes them around as opaque i8* pointers
+	//a null pointer is the empty string
+	struct string_object
+	{
+		static const std::int32_t immortal = -1;		//reference count of interned literals
+		static const std::size_t inline_capacity = 23;
+		static const std::uint32_t in_region = 1;		//the object belongs to the region of a top-level expression
+		static const std::uint32_t buffer_in_region = 2;		//so does its buffer, which is not the case when a spawned call extended it
+		static const std::uint32_t view = 4;		//'data' points into a mapped input file and is not owned
+
+		std::atomic<std::int32_t> ref_count;
+		std::uint32_t flags;
+		std::size_t length;
+		std::size_t capacity;
+		char * data;		//points to inline_data for short strings
+		input_file * file;		//the file a view points into, it stays mapped while the view lives
+		char inline_data[inline_capacity + 1];
+	};
+
+	//runtime representation of 'future' values, the pending result of a call started by 'spawn'
+	struct future_object;
+
 	class lib
 	{
+		static const std::size_t array_alignment = 64;
 	public:
-		static void import()
-		{
-			LLVMAddSymbol("print_number", &lib::print_number);
-			LLVMAddSymbol("print_string", &lib::print_string);
-			LLVMAddSymbol("str_cat", &lib::str_cat);
-		}
-
-		static void print_number(double d)
-		{
-			std::cout << d << std::flush;
-		}
-
-		static void print_string(char *s)
-		{
-			std::cout << s << std::flush;
-		}
-
-		static char * str_cat(char * left, char * right)
-		{
-			auto len = std::strlen(left) + std::strlen(right) + 1;
-			auto new_str = new char[len];
-
-			for (unsigned i = 0; i < std::strlen(left); ++i)
-				new_str[i] = left[i];
-
-			for (unsigned i = 0; i < std::strlen(right); ++i)
-				new_str[i + strlen(left)] = right[i];
-
-			new_str[len - 1] = '\0';
-			return new_str;
-		}
+		static void import();
+
+		static void enter_region();
+		static void leave_region();
+
+		static string_object * make_string(const char * str, std::size_t length, std::size_t capacity);
+		static string_object * make_literal(const std::string & str);
+		static void destroy_string(string_object * str);
+
+		static void print_number(double d);
+		static void print_string(string_object * s);
+		static void flush();
+		static void echo_number(double d);
+		static void echo_string(string_object * s);
+
+		static double open_file(string_object * path);
+		static void close_file(double file);
+		static double end_of_file(double file);
+		static double end_of_line(double file);
+		static string_object * read_line(double file);
+		static string_object * read_field(double file, string_object * separator);
+		static double read_number(double file, string_object * separator);
+
+		static string_object * str_cat(string_object * left, string_object * right);
+		static string_object * str_append(string_object * dest, string_object * piece);
+		static int str_equal(string_object * left, string_object * right);
+		static string_object * str_retain(string_object * str);
+		static void str_release(string_object * str);
+
+		static void parallel_for(void * body, void * env, double count);
+		static double parallel_reduce(void * body, std::int64_t op, void * env, double count);
+
+		static future_object * spawn(void * body, void * env, std::int64_t size);
+		static double await(future_object * future);
+		static void await_all();
+
+		static double clock_ns();
+		static double cycle_count();
+		static double bench(void * body, void * env, double iterations, string_object * name);
+
+		static array_object * array_new(double length);
+		static void array_out_of_bounds(std::int64_t index, std::int64_t length);
 	};
-}
\ No newline at end of file
+}
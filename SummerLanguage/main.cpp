@@ -1,4 +1,6 @@
 #include "parser.h"
+#include "thread_pool.h"
+#include "repl.h"
 #include <fstream>
 #include <vector>
 #include <cstdlib>
@@ -8,13 +10,92 @@ using namespace summer_lang;
 
 int main(int argc, char * argv[])
 {
-	if (argc != 2)
+	vector<string> file_names;
+	auto time_report = false;
+	string time_report_json;
+	auto jit_symbols = false;
+	auto debug_info = false;
+	auto fast_math = false;
+	vector<string> libraries;
+	auto threads = -1;
+	auto grain = 0ll;
+
+	for (auto i = 1; i < argc; ++i)
 	{
-		cerr << "Illegal format of input" << endl;
-		exit(EXIT_FAILURE);
+		string arg = argv[i];
+		if (arg == "--time-report")
+			time_report = true;
+		else if (arg.compare(0, 19, "--time-report-json=") == 0)
+			time_report_json = arg.substr(19);
+		else if (arg == "--jit-symbols")
+			jit_symbols = true;
+		else if (arg == "--debug-info")
+			debug_info = true;
+		else if (arg == "--ffast-math")
+			fast_math = true;
+		else if (arg == "--load" && i + 1 < argc)
+			libraries.push_back(argv[++i]);
+		else if (arg == "--threads" && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (arg == "--grain" && i + 1 < argc)
+			grain = atoll(argv[++i]);
+		else if (arg.compare(0, 2, "--") != 0)
+			file_names.push_back(arg);
+		else
+		{
+			cerr << "Illegal format of input" << endl;
+			exit(EXIT_FAILURE);
+		}
 	}
 
+	//the calling thread helps running every loop, so it is not counted as a worker
+	if (threads >= 0 || grain > 0)
+		thread_pool::configure(threads > 0 ? threads - 1 : static_cast<size_t>(-1), grain > 0 ? grain : 0);
+
+	compile_statistics statistics;
 	parser global_parser;
-	global_parser.parse(argv[1]);
+	if (time_report || !time_report_json.empty())
+		global_parser.set_statistics(&statistics);
+	if (jit_symbols)
+		global_parser.enable_jit_symbols();
+	if (debug_info)
+		global_parser.enable_debug_info();
+	if (fast_math)
+		global_parser.enable_fast_math();
+	for (auto & library : libraries)
+		global_parser.load_library(library);
+
+	//without a file the input is read as a REPL session, '-' reads it from a pipe without prompts
+	if (file_names.empty() || (file_names.size() == 1 && file_names.front() == "-"))
+	{
+		global_parser.enable_echo();
+		global_parser.enable_quick_expressions();
+		repl session(global_parser);
+		if (time_report)
+			session.report_latency(cerr);
+		session.run(cin, file_names.empty() ? &cout : nullptr);
+	}
+	else
+	{
+		//output already produced by the program must not be lost when compilation fails later
+		try
+		{
+			global_parser.parse(file_names);
+		}
+		catch (...)
+		{
+			lib::flush();
+			throw;
+		}
+	}
+	lib::flush();
+
+	if (time_report)
+		statistics.report(cerr);
+	if (!time_report_json.empty())
+	{
+		ofstream report(time_report_json.c_str());
+		statistics.report_json(report);
+	}
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,193 @@
+#include "mapped_file.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace summer_lang
+{
+	mapped_file::mapped_file()
+		: data_(nullptr)
+		, size_(0)
+		, position_(0)
+		, pending_break_(false)
+#ifdef _WIN32
+		, file_(INVALID_HANDLE_VALUE)
+		, mapping_(nullptr)
+#endif
+	{
+	}
+
+	mapped_file::~mapped_file()
+	{
+		close();
+	}
+
+	bool mapped_file::open(const std::string & path)
+	{
+		close();
+#ifdef _WIN32
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size))
+		{
+			close();
+			return false;
+		}
+		size_ = static_cast<std::size_t>(size.QuadPart);
+
+		//an empty file can not be mapped, it just has no lines
+		if (size_)
+		{
+			mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data_ = mapping_ ? static_cast<const char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+			if (!data_)
+			{
+				close();
+				return false;
+			}
+		}
+#else
+		auto fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		size_ = static_cast<std::size_t>(info.st_size);
+
+		if (size_)
+		{
+			auto address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (address == MAP_FAILED)
+			{
+				::close(fd);
+				size_ = 0;
+				return false;
+			}
+			data_ = static_cast<const char *>(address);
+			madvise(address, size_, MADV_SEQUENTIAL);
+		}
+		::close(fd);
+#endif
+		position_ = 0;
+		pending_break_ = false;
+		return true;
+	}
+
+	void mapped_file::close()
+	{
+#ifdef _WIN32
+		if (data_)
+			UnmapViewOfFile(data_);
+		if (mapping_)
+			CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle(file_);
+		file_ = INVALID_HANDLE_VALUE;
+		mapping_ = nullptr;
+#else
+		if (data_)
+			munmap(const_cast<char *>(data_), size_);
+#endif
+		data_ = nullptr;
+		size_ = 0;
+		position_ = 0;
+		pending_break_ = false;
+	}
+
+	std::size_t mapped_file::line_end_() const
+	{
+		auto found = static_cast<const char *>(std::memchr(data_ + position_, '\n', size_ - position_));
+		auto end = found ? static_cast<std::size_t>(found - data_) : size_;
+		if (end > position_ && data_[end - 1] == '\r')
+			--end;
+		return end;
+	}
+
+	//0 when the cursor is not at a line break
+	std::size_t mapped_file::line_break_length_() const
+	{
+		if (position_ == size_)
+			return 0;
+		if (data_[position_] == '\n')
+			return 1;
+		if (data_[position_] == '\r')
+			return position_ + 1 == size_ ? 1 : data_[position_ + 1] == '\n' ? 2 : 0;
+		return 0;
+	}
+
+	bool mapped_file::at_line_end() const
+	{
+		return at_end() || data_[position_] == '\n' || (data_[position_] == '\r' && (position_ + 1 == size_ || data_[position_ + 1] == '\n'));
+	}
+
+	bool mapped_file::next_line(const char * & begin, std::size_t & length)
+	{
+		if (at_end())
+			return false;
+
+		pending_break_ = false;
+		auto end = line_end_();
+		begin = data_ + position_;
+		length = end - position_;
+
+		position_ = end;
+		if (position_ != size_ && data_[position_] == '\r')
+			++position_;
+		if (position_ != size_)
+			++position_;
+		return true;
+	}
+
+	bool mapped_file::next_field(char separator, const char * & begin, std::size_t & length)
+	{
+		if (at_end())
+			return false;
+
+		if (pending_break_)
+		{
+			position_ += line_break_length_();
+			pending_break_ = false;
+		}
+
+		auto end = line_end_();
+		if (!separator)
+		{
+			while (position_ != end && (data_[position_] == ' ' || data_[position_] == '\t'))
+				++position_;
+			auto field_end = position_;
+			while (field_end != end && data_[field_end] != ' ' && data_[field_end] != '\t')
+				++field_end;
+
+			begin = data_ + position_;
+			length = field_end - position_;
+			position_ = field_end;
+			while (position_ != end && (data_[position_] == ' ' || data_[position_] == '\t'))
+				++position_;
+			pending_break_ = position_ == end;
+			return true;
+		}
+
+		auto found = static_cast<const char *>(std::memchr(data_ + position_, separator, end - position_));
+		auto field_end = found ? static_cast<std::size_t>(found - data_) : end;
+		begin = data_ + position_;
+		length = field_end - position_;
+		position_ = found ? field_end + 1 : field_end;
+		pending_break_ = !found;
+		return true;
+	}
+}
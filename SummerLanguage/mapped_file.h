@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace summer_lang
+{
+	//A file mapped read-only into memory with a cursor that walks it line by line or field by field.
+	//Pieces are returned as pointers into the mapping, nothing is copied.
+	//Fields can be read one after the other across lines: once the last field of a line has been read the cursor
+	//stays at the line break, so at_line_end() tells that the record is complete, and the next field read steps over it.
+	class mapped_file
+	{
+		const char * data_;
+		std::size_t size_;
+		std::size_t position_;
+		bool pending_break_;		//the last field ran to the end of its line, the next field starts on the next one
+#ifdef _WIN32
+		void * file_;
+		void * mapping_;
+#endif
+
+		std::size_t line_end_() const;
+		std::size_t line_break_length_() const;
+	public:
+		mapped_file(const mapped_file &) = delete;
+		mapped_file & operator=(const mapped_file &) = delete;
+
+		mapped_file();
+		~mapped_file();
+
+		bool open(const std::string & path);
+		void close();
+
+		//nothing but the line break after the last field read is left
+		bool at_end() const
+		{
+			return position_ == size_ || (pending_break_ && position_ + line_break_length_() == size_);
+		}
+
+		//at a line break or at the end of the file
+		bool at_line_end() const;
+
+		//the rest of the current line without its line break, the cursor moves to the start of the next line
+		bool next_line(const char * & begin, std::size_t & length);
+		//the text up to 'separator' or the end of the line, the cursor moves past the separator but stays on the line;
+		//a field read after the last one of a line comes from the next line, an empty line has one empty field
+		//a separator of 0 splits at runs of spaces and tabs
+		bool next_field(char separator, const char * & begin, std::size_t & length);
+	};
+}
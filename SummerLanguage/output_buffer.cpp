@@ -0,0 +1,88 @@
+#include "output_buffer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+namespace summer_lang
+{
+	output_buffer::output_buffer()
+		: size_(0)
+		, flush_on_newline_(isatty(fileno(stdout)) != 0)
+	{
+	}
+
+	output_buffer::~output_buffer()
+	{
+		flush();
+	}
+
+	void output_buffer::write(const char * data, std::size_t length)
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		if (size_ + length > capacity)
+		{
+			flush();
+			if (length > capacity)
+			{
+				std::fwrite(data, 1, length, stdout);
+				std::fflush(stdout);
+				return;
+			}
+		}
+
+		std::memcpy(buffer_ + size_, data, length);
+		size_ += length;
+		if (flush_on_newline_ && std::memchr(data, '\n', length))
+			flush();
+	}
+
+	//prints the shortest digits that read back as the same double
+	void output_buffer::write_number(double d)
+	{
+		char digits[32];
+#if defined(__cpp_lib_to_chars)
+		auto result = std::to_chars(digits, digits + sizeof(digits), d);
+		write(digits, result.ptr - digits);
+#else
+		auto length = 0;
+		for (auto precision = 15; precision <= 17; ++precision)
+		{
+			length = std::snprintf(digits, sizeof(digits), "%.*g", precision, d);
+			if (std::strtod(digits, nullptr) == d)
+				break;
+		}
+		write(digits, length);
+#endif
+	}
+
+	void output_buffer::flush()
+	{
+		std::lock_guard<std::recursive_mutex> lock(mutex_);
+		if (!size_)
+			return;
+
+		std::fwrite(buffer_, 1, size_, stdout);
+		std::fflush(stdout);
+		size_ = 0;
+	}
+
+	output_buffer & output_buffer::get_stdout()
+	{
+		static output_buffer buffer;
+		return buffer;
+	}
+}
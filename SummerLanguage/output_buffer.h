@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+
+namespace summer_lang
+{
+	//Collects the output of a program in user space and hands it to stdout in large writes.
+	//When stdout is a terminal, every completed line is written right away so interactive output is not delayed.
+	class output_buffer
+	{
+		static const std::size_t capacity = 1 << 16;
+
+		char buffer_[capacity];
+		std::size_t size_;
+		bool flush_on_newline_;
+		std::recursive_mutex mutex_;		//bodies of 'parallel for' print from several threads
+	public:
+		output_buffer(const output_buffer &) = delete;
+		output_buffer & operator=(const output_buffer &) = delete;
+
+		output_buffer();
+		~output_buffer();
+
+		void write(const char * data, std::size_t length);
+		void write_number(double d);
+		void flush();
+
+		//the buffer of the process, flushed when the process exits
+		static output_buffer & get_stdout();
+	};
+}
@@ -1,115 +1,570 @@
 #include "parser.h"
+#include <llvm\ADT\SmallString.h>
+#include <llvm\Support\FileSystem.h>
+#include <llvm\Support\Path.h>
 #include <cassert>
+#include <mutex>
 
 namespace summer_lang
 {
-	parser::parser()
+	std::atomic<std::size_t> ast::created_count_(0);
+	thread_local compile_context * global_context = nullptr;
+
+	//the native target and the runtime symbols are registered once for the whole process
+	static std::once_flag initialize_flag;
+
+	static void initialize_process()
 	{
 		llvm::InitializeNativeTarget();
 		llvm::InitializeNativeTargetAsmParser();
 		llvm::InitializeNativeTargetAsmPrinter();
-		auto & context = llvm::getGlobalContext();
-		global_JIT_helper = std::make_unique<MCJIT_helper>(context);
+		lib::import();
+	}
 
-		std::vector<llvm::Type *> args_type{ llvm::Type::getInt8PtrTy(llvm::getGlobalContext()), llvm::Type::getInt8PtrTy(llvm::getGlobalContext()) };
-		auto function_type = llvm::FunctionType::get(llvm::Type::getInt8PtrTy(llvm::getGlobalContext()), args_type, false);
-		auto module = global_JIT_helper->get_module_for_new_function();
+	parser::parser()
+		: context_(std::make_unique<compile_context>())
+		, statistics_(nullptr)
+		, debug_info_(false)
+		, echo_(false)
+		, lex_seconds_(0)
+		, token_count_(0)
+	{
+		std::call_once(initialize_flag, initialize_process);
+		context_scope scope(context_.get());
+		auto & context = global_context->llvm_context;
+		global_context->JIT_helper = std::make_unique<MCJIT_helper>(context);
+
+		std::vector<llvm::Type *> args_type{ llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context) };
+		auto function_type = llvm::FunctionType::get(llvm::Type::getInt8PtrTy(context), args_type, false);
+		auto module = global_context->JIT_helper->get_module_for_new_function();
 		auto function = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, "str_cat", module);
+		llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, "str_append", module);
 
-		global_op_precedence["="] = 2;
-		global_op_precedence["<"] = 10;
-		global_op_precedence[">"] = 10;
-		global_op_precedence[">="] = 10;
-		global_op_precedence["<="] = 10;
-		global_op_precedence["=="] = 10;
-		global_op_precedence["<>"] = 10;
+		auto array_function_type = llvm::FunctionType::get(global_array_type(), { llvm::Type::getDoubleTy(context) }, false);
+		llvm::Function::Create(array_function_type, llvm::Function::ExternalLinkage, "array", module);
 
-		global_op_precedence["+"] = 20;
-		global_op_precedence["-"] = 20;
-		global_op_precedence["*"] = 40;
-		global_op_precedence["/"] = 40;
+		auto parallel_function_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context), llvm::Type::getDoubleTy(context) }, false);
+		llvm::Function::Create(parallel_function_type, llvm::Function::ExternalLinkage, "parallel_for", module);
 
-		lib::import();
+		auto reduce_function_type = llvm::FunctionType::get(llvm::Type::getDoubleTy(context), { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt64Ty(context), llvm::Type::getInt8PtrTy(context), llvm::Type::getDoubleTy(context) }, false);
+		llvm::Function::Create(reduce_function_type, llvm::Function::ExternalLinkage, "parallel_reduce", module);
+
+		auto spawn_function_type = llvm::FunctionType::get(global_future_type(), { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context), llvm::Type::getInt64Ty(context) }, false);
+		llvm::Function::Create(spawn_function_type, llvm::Function::ExternalLinkage, "spawn", module);
+
+		auto await_function_type = llvm::FunctionType::get(llvm::Type::getDoubleTy(context), { global_future_type() }, false);
+		llvm::Function::Create(await_function_type, llvm::Function::ExternalLinkage, "await", module);
+
+		auto echo_number_function_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getDoubleTy(context) }, false);
+		llvm::Function::Create(echo_number_function_type, llvm::Function::ExternalLinkage, "echo_number", module);
+
+		auto echo_string_function_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getInt8PtrTy(context) }, false);
+		llvm::Function::Create(echo_string_function_type, llvm::Function::ExternalLinkage, "echo_string", module);
+
+		auto bench_function_type = llvm::FunctionType::get(llvm::Type::getDoubleTy(context), { llvm::Type::getInt8PtrTy(context), llvm::Type::getInt8PtrTy(context), llvm::Type::getDoubleTy(context), llvm::Type::getInt8PtrTy(context) }, false);
+		llvm::Function::Create(bench_function_type, llvm::Function::ExternalLinkage, "bench", module);
+
+		auto flush_function_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), false);
+		llvm::Function::Create(flush_function_type, llvm::Function::ExternalLinkage, "flush", module);
+
+		auto bounds_function_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getInt64Ty(context), llvm::Type::getInt64Ty(context) }, false);
+		llvm::Function::Create(bounds_function_type, llvm::Function::ExternalLinkage, "array_out_of_bounds", module);
+
+		auto equal_function_type = llvm::FunctionType::get(llvm::Type::getInt32Ty(context), args_type, false);
+		llvm::Function::Create(equal_function_type, llvm::Function::ExternalLinkage, "str_equal", module);
+
+		auto retain_function_type = llvm::FunctionType::get(llvm::Type::getInt8PtrTy(context), { llvm::Type::getInt8PtrTy(context) }, false);
+		llvm::Function::Create(retain_function_type, llvm::Function::ExternalLinkage, "str_retain", module);
+
+		auto release_function_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context), { llvm::Type::getInt8PtrTy(context) }, false);
+		llvm::Function::Create(release_function_type, llvm::Function::ExternalLinkage, "str_release", module);
+
+		global_context->op_precedence["="] = 2;
+		global_context->op_precedence["<"] = 10;
+		global_context->op_precedence[">"] = 10;
+		global_context->op_precedence[">="] = 10;
+		global_context->op_precedence["<="] = 10;
+		global_context->op_precedence["=="] = 10;
+		global_context->op_precedence["<>"] = 10;
+
+		global_context->op_precedence["+"] = 20;
+		global_context->op_precedence["-"] = 20;
+		global_context->op_precedence["*"] = 40;
+		global_context->op_precedence["/"] = 40;
+	}
+
+	//the types it builds are created by the session's parser before any worker starts, so its context is only read
+	parser::parser(parse_only)
+		: statistics_(nullptr)
+		, debug_info_(false)
+		, echo_(false)
+		, lex_seconds_(0)
+		, token_count_(0)
+	{
 	}
 
 	void parser::handle_extern()
 	{
-		auto proto_ast = parse_extern_();
-		auto ir = proto_ast->codegen();
+		auto record = begin_record_();
+		std::unique_ptr<prototype_ast> proto_ast;
+		{
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::PARSE)] : nullptr);
+			proto_ast = parse_extern_();
+		}
+		end_parse_record_(record, proto_ast->get_name());
+		define_extern_(std::move(proto_ast), record);
+	}
+
+	void parser::define_extern_(std::unique_ptr<prototype_ast> proto_ast, function_statistics * record)
+	{
+		llvm::Function * ir;
+		{
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::CODEGEN)] : nullptr);
+			ir = proto_ast->codegen();
+		}
+		codegen_record_(record, ir);
 		//ir->dump();
 	}
 
+	//imports of Summer sources are compiled into the session, any other path is a native library
+	static bool is_source_path(const std::string & path)
+	{
+		return path.size() > 3 && path.compare(path.size() - 3, 3, ".sl") == 0;
+	}
+
+	static std::string directory_of(const std::string & path)
+	{
+		auto separator = path.find_last_of("/\\");
+		return separator == std::string::npos ? "" : path.substr(0, separator + 1);
+	}
+
+	//units are keyed by this, so 'b.sl', './b.sl' and 'a/../b.sl' are the same file
+	static std::string canonical_path(const std::string & path)
+	{
+		llvm::SmallString<256> canonical(path);
+		llvm::sys::fs::make_absolute(canonical);
+		llvm::sys::path::remove_dots(canonical, true);
+		return canonical.str();
+	}
+
+	static std::string resolve_path(const std::string & directory, const std::string & path)
+	{
+		auto absolute = !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+		return canonical_path(absolute ? path : directory + path);
+	}
+
+	void parser::handle_import()
+	{
+		get_next_token_();
+		if (current_token_->get_type() != token_categories::LITERAL_STRING)
+			throw syntax_error("Expected a library path after \'import\'", current_token_->get_position());
+
+		auto path = get_value<literal_string>(current_token_);
+		if (is_source_path(path))
+			import_source_(resolve_path(directory_, path));
+		else
+			load_library(path);
+		get_next_token_();
+	}
+
 	void parser::handle_function()
 	{
-		auto func_ast = parse_function_();
-		auto ir = func_ast->codegen();
+		auto record = begin_record_();
+		std::unique_ptr<function_ast> func_ast;
+		{
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::PARSE)] : nullptr);
+			func_ast = parse_function_();
+		}
+		end_parse_record_(record, func_ast->get_name());
+		define_function_(std::move(func_ast), record);
+	}
+
+	void parser::define_function_(std::unique_ptr<function_ast> func_ast, function_statistics * record)
+	{
+		llvm::Function * ir;
+		{
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::CODEGEN)] : nullptr);
+			ir = func_ast->codegen();
+		}
+		codegen_record_(record, ir);
 		//ir->dump();
 	}
 
 	void parser::handle_top_level_expr()
 	{
-		auto func_ast = parse_top_level_expr_();
-		auto ir = func_ast->codegen();
+		auto record = begin_record_();
+		std::unique_ptr<function_ast> func_ast;
+		{
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::PARSE)] : nullptr);
+			func_ast = parse_top_level_expr_();
+		}
+		end_parse_record_(record, MCJIT_helper::generate_function_name(func_ast->get_name()));
+		run_top_level_expr_(std::move(func_ast), record);
+	}
+
+	void parser::run_top_level_expr_(std::unique_ptr<function_ast> func_ast, function_statistics * record)
+	{
+		if (echo_)
+			func_ast->set_echo();
+
+		//compile pending definitions now, so that their emission is not counted as code generation of this expression
+		global_context->JIT_helper->get_module_for_anonymous_function();
+
+		llvm::Function * ir;
+		{
+			phase_timer timer(record ? &record->seconds[static_cast<int>(phase_categories::CODEGEN)] : nullptr);
+			ir = func_ast->codegen();
+		}
+		codegen_record_(record, ir);
 		//ir->dump();
-		auto p_function = (double(*)())(intptr_t)global_JIT_helper->get_pointer_to_function(ir);
+		double(*p_function)();
+		try
+		{
+			p_function = (double(*)())(intptr_t)global_context->JIT_helper->get_pointer_to_function(ir);
+		}
+		catch (...)
+		{
+			//an expression whose module fails to link is dropped with its engine, like one that has run
+			global_context->JIT_helper->release_function(ir);
+			throw;
+		}
+		lib::enter_region();
 		p_function();
+		lib::await_all();
+		lib::leave_region();
+		global_context->JIT_helper->release_function(ir);
+	}
+
+	function_statistics * parser::begin_record_()
+	{
+		if (!statistics_)
+			return nullptr;
+
+		record_lex_seconds_ = lex_seconds_;
+		record_token_count_ = token_count_;
+		record_ast_count_ = ast::get_created_count();
+		return &statistics_->begin_function(current_token_->get_position());
+	}
+
+	void parser::end_parse_record_(function_statistics * record, const std::string & name)
+	{
+		if (!record)
+			return;
+
+		//tokens are pulled by the parser, so the lexing time is part of the parse timer
+		record->name = name;
+		record->seconds[static_cast<int>(phase_categories::LEX)] = lex_seconds_ - record_lex_seconds_;
+		record->seconds[static_cast<int>(phase_categories::PARSE)] -= lex_seconds_ - record_lex_seconds_;
+		record->tokens = token_count_ - record_token_count_;
+		record->ast_nodes = ast::get_created_count() - record_ast_count_;
+	}
+
+	void parser::codegen_record_(function_statistics * record, llvm::Function * function)
+	{
+		if (!record)
+			return;
+
+		for (auto & basic_block : *function)
+			record->ir_instructions += basic_block.size();
+	}
+
+	//every entry point compiles with the parser's own context, whichever thread it is called on
+	void parser::set_statistics(compile_statistics * statistics)
+	{
+		context_scope scope(context_.get());
+		statistics_ = statistics;
+		global_context->JIT_helper->set_statistics(statistics);
+	}
+
+	void parser::enable_jit_symbols()
+	{
+		context_scope scope(context_.get());
+		global_context->JIT_helper->enable_jit_symbols();
+	}
+
+	void parser::enable_debug_info()
+	{
+		debug_info_ = true;
+	}
+
+	void parser::enable_fast_math()
+	{
+		context_scope scope(context_.get());
+		global_context->JIT_helper->enable_fast_math();
+	}
+
+	void parser::enable_echo()
+	{
+		echo_ = true;
+	}
+
+	void parser::enable_quick_expressions()
+	{
+		context_scope scope(context_.get());
+		global_context->JIT_helper->enable_quick_anonymous();
+	}
+
+	void parser::load_library(const std::string & path)
+	{
+		context_scope scope(context_.get());
+		global_context->JIT_helper->load_library(path);
+	}
+
+	llvm::Function * parser::find_function(const std::string & name) const
+	{
+		context_scope scope(context_.get());
+		return global_context->JIT_helper->find_definition(name);
+	}
+
+	void * parser::get_function_address(llvm::Function * function)
+	{
+		context_scope scope(context_.get());
+		return global_context->JIT_helper->get_pointer_to_function(function);
 	}
 
 	void parser::parse(const std::string & file_name)
 	{
+		context_scope scope(context_.get());
 		std::ifstream source_code(file_name.c_str());
 		if (!source_code.is_open())
 			throw std::fstream::failure("Can't open file " + file_name);
-		else
+
+		if (debug_info_)
+			global_context->JIT_helper->enable_debug_info(file_name);
+
+		//a file importing the one being run does not run it again
+		auto path = canonical_path(file_name);
+		auto unit = std::make_unique<source_unit>();
+		unit->path = path;
+		unit->compiled = true;
+		units_[path] = std::move(unit);
+		directory_ = directory_of(file_name);
+		parse(source_code);
+	}
+
+	//debug info describes a single source file, so it is only emitted when one file is run
+	void parser::parse(const std::vector<std::string> & file_names)
+	{
+		context_scope scope(context_.get());
+		if (file_names.size() == 1)
+		{
+			parse(file_names.front());
+			return;
+		}
+
+		std::vector<std::string> paths;
+		for (auto & file_name : file_names)
+			paths.push_back(canonical_path(file_name));
+		load_units_(paths);
+		for (auto & path : paths)
+			compile_unit_(*units_[path]);
+	}
+
+	//definitions stay compiled across calls, so a REPL can feed its input piece by piece
+	void parser::parse(std::istream & source_code)
+	{
+		context_scope scope(context_.get());
+		p_tokenizer_ = std::make_unique<tokenizer>(source_code);
+
+		get_next_token_();
+		while (current_token_->get_type() != token_categories::END)
+		{
+			if (current_token_->get_type() == token_categories::KEYWORD)
+			{
+				auto type = get_value<keyword>(current_token_);
+				if (type == keyword_categories::EXTERN)
+				{
+					handle_extern();
+					continue;
+				}
+				if (type == keyword_categories::FUNCTION)
+				{
+					handle_function();
+					continue;
+				}
+				if (type == keyword_categories::IMPORT)
+				{
+					handle_import();
+					continue;
+				}
+			}
+			handle_top_level_expr();
+		}
+		p_tokenizer_.reset();
+	}
+
+	std::unique_ptr<parser::source_unit> parser::parse_unit_(const std::string & path)
+	{
+		auto unit = std::make_unique<source_unit>();
+		unit->path = path;
+		unit->compiled = false;
+		directory_ = directory_of(path);
+
+		//errors can not leave a worker thread, they are kept with the unit
+		try
 		{
+			std::ifstream source_code(path.c_str());
+			if (!source_code.is_open())
+				throw std::fstream::failure("Can't open file " + path);
 			p_tokenizer_ = std::make_unique<tokenizer>(source_code);
 
 			get_next_token_();
-			while (true)
+			while (current_token_->get_type() != token_categories::END)
 			{
-				switch (current_token_->get_type())
+				source_item item;
+				item.row_no = current_token_->get_position();
+				auto type = current_token_->get_type() == token_categories::KEYWORD ? get_value<keyword>(current_token_) : keyword_categories::END;
+				if (type == keyword_categories::EXTERN)
 				{
-				case token_categories::END:
-					return;
-				case token_categories::KEYWORD:
+					item.type = item_categories::EXTERN;
+					item.prototype = parse_extern_();
+				}
+				else if (type == keyword_categories::FUNCTION)
 				{
-					auto type = get_value<keyword>(current_token_);
-					switch (type)
-					{
-					case keyword_categories::EXTERN:
-						handle_extern();
-						continue;
-					case keyword_categories::FUNCTION:
-						handle_function();
-						continue;
-					default:
-						break;
-					}
+					item.type = item_categories::FUNCTION;
+					item.function = parse_function_();
 				}
-				default:
-					handle_top_level_expr();
-					break;
+				else if (type == keyword_categories::IMPORT)
+				{
+					get_next_token_();
+					if (current_token_->get_type() != token_categories::LITERAL_STRING)
+						throw syntax_error("Expected a library path after \'import\'", current_token_->get_position());
+
+					item.type = item_categories::IMPORT;
+					item.path = get_value<literal_string>(current_token_);
+					if (is_source_path(item.path))
+						item.path = resolve_path(directory_, item.path);
+					get_next_token_();
+				}
+				else
+				{
+					item.type = item_categories::EXPRESSION;
+					item.function = parse_top_level_expr_();
+				}
+				unit->items.push_back(std::move(item));
+			}
+		}
+		catch (std::exception & e)
+		{
+			unit->error = path + ": " + e.what();
+		}
+		p_tokenizer_.reset();
+		return unit;
+	}
+
+	double parser::parse_unit_task_(void * env)
+	{
+		auto task = static_cast<unit_task *>(env);
+		context_scope scope(task->context);
+		parser worker{ parse_only() };
+		task->unit = worker.parse_unit_(task->path);
+		return 0.0;
+	}
+
+	//files are parsed in waves, each file on its own task: the sources imported by one wave make up the next
+	void parser::load_units_(const std::vector<std::string> & paths)
+	{
+		std::vector<std::string> wave;
+		for (auto & path : paths)
+			if (units_.find(path) == units_.end() && std::find(wave.begin(), wave.end(), path) == wave.end())
+				wave.push_back(path);
+
+		auto & pool = thread_pool::get();
+		while (!wave.empty())
+		{
+			std::vector<unit_task> tasks(wave.size());
+			std::vector<std::unique_ptr<thread_pool::job>> jobs;
+			for (std::size_t i = 0; i != wave.size(); ++i)
+			{
+				tasks[i].context = context_.get();
+				tasks[i].path = wave[i];
+				jobs.emplace_back(pool.spawn(&parse_unit_task_, &tasks[i]));
+			}
+			for (auto & job : jobs)
+				pool.wait(*job);
+
+			std::vector<std::string> next_wave;
+			for (auto & task : tasks)
+			{
+				for (auto & item : task.unit->items)
+				{
+					if (item.type != item_categories::IMPORT || !is_source_path(item.path))
+						continue;
+					if (units_.find(item.path) == units_.end() && std::find(wave.begin(), wave.end(), item.path) == wave.end()
+						&& std::find(next_wave.begin(), next_wave.end(), item.path) == next_wave.end())
+						next_wave.push_back(item.path);
 				}
+				units_[task.path] = std::move(task.unit);
+			}
+			wave = std::move(next_wave);
+		}
+	}
+
+	//items run in source order, an import compiles its file first unless an earlier importer already did
+	void parser::compile_unit_(source_unit & unit)
+	{
+		if (unit.compiled)
+			return;
+		unit.compiled = true;
+
+		for (auto & item : unit.items)
+		{
+			switch (item.type)
+			{
+			case item_categories::EXTERN:
+				define_extern_(std::move(item.prototype), nullptr);
+				break;
+			case item_categories::FUNCTION:
+				define_function_(std::move(item.function), nullptr);
+				break;
+			case item_categories::EXPRESSION:
+				run_top_level_expr_(std::move(item.function), nullptr);
+				break;
+			case item_categories::IMPORT:
+				if (is_source_path(item.path))
+					compile_unit_(*units_[item.path]);
+				else
+					load_library(item.path);
+				break;
 			}
-			p_tokenizer_.reset();
 		}
+		unit.items.clear();
+
+		if (!unit.error.empty())
+			throw std::exception(unit.error.c_str());
+	}
+
+	void parser::import_source_(const std::string & path)
+	{
+		load_units_({ path });
+		compile_unit_(*units_[path]);
 	}
 
 	void parser::get_next_token_()
 	{
+		phase_timer timer(statistics_ ? &lex_seconds_ : nullptr);
 		current_token_ = std::move(p_tokenizer_->get_token());
+		token_count_++;
+	}
+
+	int parser::get_op_precedence_(const std::string & op) const
+	{
+		auto found = op_precedence_.find(op);
+		if (found != op_precedence_.end())
+			return found->second;
+		return get_op_precedence(op);
 	}
 
 	int get_op_precedence(const std::string & op)
 	{
-		if (global_op_precedence.find(op) != global_op_precedence.end())
-			return global_op_precedence[op];
+		if (global_context->op_precedence.find(op) != global_context->op_precedence.end())
+			return global_context->op_precedence[op];
 		return -1;
 	}
 
 	void set_op_precedence(const std::string & op, int precedence)
 	{
-		global_op_precedence[op] = precedence;
+		global_context->op_precedence[op] = precedence;
 	}
 
 	llvm::AllocaInst * global_create_alloca(llvm::Function * parent, const std::string & name, llvm::Type * type)
@@ -118,6 +573,103 @@ namespace summer_lang
 		return temp_block.CreateAlloca(type, 0, name.c_str());
 	}
 
+	void global_emit_location(const ast * node)
+	{
+		if (auto info = global_context->JIT_helper->get_debug_info())
+			info->emit_location(global_context->builder, node->get_position());
+	}
+
+	//strings are reference counted, a string value is either owned (a fresh reference the code must
+	//release or hand over) or borrowed (a literal or a variable's current value)
+	bool global_is_string(llvm::Value * value)
+	{
+		return value->getType() == llvm::Type::getInt8PtrTy(global_context->llvm_context);
+	}
+
+	bool global_is_owned(llvm::Value * value)
+	{
+		return global_is_string(value) && (llvm::isa<llvm::CallInst>(value) || llvm::isa<llvm::PHINode>(value));
+	}
+
+	llvm::Value * global_retain(llvm::Value * value)
+	{
+		return global_context->builder.CreateCall(global_context->JIT_helper->get_function("str_retain"), { value }, "retained");
+	}
+
+	void global_release(llvm::Value * value)
+	{
+		global_context->builder.CreateCall(global_context->JIT_helper->get_function("str_release"), { value });
+	}
+
+	void global_release_temporary(llvm::Value * value)
+	{
+		if (value && global_is_owned(value))
+			global_release(value);
+	}
+
+	void global_store_string(llvm::Value * value, llvm::AllocaInst * slot)
+	{
+		if (!global_is_owned(value))
+			value = global_retain(value);
+		auto old_value = global_context->builder.CreateLoad(slot);
+		global_context->builder.CreateStore(value, slot);
+		global_release(old_value);
+	}
+
+	void global_release_slots(std::size_t first)
+	{
+		for (auto i = first; i < global_context->string_slots.size(); ++i)
+			global_release(global_context->builder.CreateLoad(global_context->string_slots[i]));
+	}
+
+	llvm::PointerType * global_array_type()
+	{
+		auto & array_type = global_context->array_type;
+		if (!array_type)
+		{
+			auto & context = global_context->llvm_context;
+			array_type = llvm::StructType::create(context, { llvm::Type::getDoublePtrTy(context), llvm::Type::getInt64Ty(context) }, "summer.array");
+		}
+		return array_type->getPointerTo();
+	}
+
+	llvm::PointerType * global_future_type()
+	{
+		auto & future_type = global_context->future_type;
+		if (!future_type)
+			future_type = llvm::StructType::create(global_context->llvm_context, "summer.future");
+		return future_type->getPointerTo();
+	}
+
+	//the header of an array never changes after allocation, so its loads may be hoisted out of loops
+	static llvm::Value * load_array_field(llvm::Value * array, unsigned index, const std::string & name)
+	{
+		auto field = global_context->builder.CreateStructGEP(global_array_type()->getElementType(), array, index);
+		auto load = global_context->builder.CreateLoad(field, name);
+		load->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(global_context->llvm_context, {}));
+		return load;
+	}
+
+	llvm::Value * global_array_data(llvm::Value * array)
+	{
+		return load_array_field(array, 0, "data");
+	}
+
+	llvm::Value * global_array_length(llvm::Value * array)
+	{
+		return load_array_field(array, 1, "length");
+	}
+
+	const variable_ast * global_length_query(const ast * node)
+	{
+		auto call = dynamic_cast<const call_expression_ast *>(node);
+		if (!call || call->get_callee() != "length" || call->get_args().size() != 1)
+			return nullptr;
+		if (global_context->JIT_helper->get_function("length"))
+			return nullptr;
+		return dynamic_cast<const variable_ast *>(call->get_args()[0].get());
+	}
+
 	std::unique_ptr<ast> parser::parse_number_()
 	{
 		auto start_row_no = current_token_->get_position();
@@ -154,6 +706,19 @@ namespace summer_lang
 		auto start_row_no = current_token_->get_position();
 
 		get_next_token_();
+		if (current_token_->get_type() == token_categories::OPERATOR && get_value<op>(current_token_) == operator_categories::LSQUARE)
+		{
+			get_next_token_();
+			auto index = parse_expression_();
+			if (!index)
+				return nullptr;
+
+			if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::RSQUARE)
+				throw syntax_error("Expected a ']' after index", current_token_->get_position());
+			get_next_token_();
+			return std::make_unique<index_ast>(std::make_unique<variable_ast>(name, start_row_no), std::move(index), start_row_no);
+		}
+
 		if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::LBRACKET)
 			return std::make_unique<variable_ast>(name, start_row_no);
 		
@@ -200,11 +765,20 @@ namespace summer_lang
 			case keyword_categories::IF:
 				return parse_if_();
 			case keyword_categories::FOR:
-				return parse_for_();
+				return parse_for_(false);
+			case keyword_categories::PARALLEL:
+				get_next_token_();
+				if (current_token_->get_type() != token_categories::KEYWORD || get_value<keyword>(current_token_) != keyword_categories::FOR)
+					throw syntax_error("Expected \'for\' after \'parallel\'", current_token_->get_position());
+				return parse_for_(true);
 			case keyword_categories::VAR:
 				return parse_var_();
 			case keyword_categories::RETURN:
 				return parse_return_();
+			case keyword_categories::SPAWN:
+				return parse_spawn_();
+			case keyword_categories::BENCH:
+				return parse_bench_();
 			default:
 				break;
 			}
@@ -242,7 +816,7 @@ namespace summer_lang
 			{
 				auto current_op = get_op_name(current_token_);
 				auto current_op_type = get_value<op>(current_token_);
-				auto current_precedence = get_op_precedence(current_op);
+				auto current_precedence = get_op_precedence_(current_op);
 
 				if (current_precedence < expr_precedence)
 					return left;
@@ -255,7 +829,7 @@ namespace summer_lang
 				if (current_token_->get_type() == token_categories::OPERATOR)
 				{
 					auto next_op = get_op_name(current_token_);
-					auto next_precedence = get_op_precedence(next_op);
+					auto next_precedence = get_op_precedence_(next_op);
 
 					if (current_precedence < next_precedence)
 					{
@@ -301,7 +875,7 @@ namespace summer_lang
 
 	}
 
-	std::unique_ptr<ast> parser::parse_for_()
+	std::unique_ptr<ast> parser::parse_for_(bool parallel)
 	{															
 		auto start_row_no = current_token_->get_position();
 		get_next_token_();
@@ -321,7 +895,7 @@ namespace summer_lang
 		switch (get_value<type>(current_token_))
 		{
 		case type_categories::NUMBER:
-			var_type = llvm::Type::getDoubleTy(llvm::getGlobalContext());
+			var_type = llvm::Type::getDoubleTy(global_context->llvm_context);
 			break;
 		default:
 			throw syntax_error("Unknown type", current_token_->get_position());
@@ -355,19 +929,56 @@ namespace summer_lang
 		if (!step)
 			step.reset(new number_ast(1, current_token_->get_position()));
 
-		if (current_token_->get_type() != token_categories::KEYWORD || get_value<keyword>(current_token_) != keyword_categories::IN)
-			throw syntax_error("Expected \"in\" between head and body of \'for\'", current_token_->get_position());
-		get_next_token_();
-		
-		auto body = parse_block_();
-		if (!body)
-			return nullptr;
+		auto reduction_op = reduction_categories::NONE;
+		std::string reduction_var;
+		if (current_token_->get_type() == token_categories::KEYWORD && get_value<keyword>(current_token_) == keyword_categories::REDUCE)
+		{
+			get_next_token_();
+			if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::LBRACKET)
+				throw syntax_error("Expected a '(' after \'reduce\'", current_token_->get_position());
+			get_next_token_();
 
-		return std::make_unique<for_expression_ast>(var_name, var_type, std::move(start), std::move(end), std::move(step), std::move(body), start_row_no);
-	}
+			if (current_token_->get_type() == token_categories::OPERATOR && get_value<op>(current_token_) == operator_categories::ADD)
+				reduction_op = reduction_categories::ADD;
+			else if (current_token_->get_type() == token_categories::OPERATOR && get_value<op>(current_token_) == operator_categories::MUL)
+				reduction_op = reduction_categories::MUL;
+			else if (current_token_->get_type() == token_categories::IDENTIFIER && get_value<identifier>(current_token_) == "min")
+				reduction_op = reduction_categories::MIN;
+			else if (current_token_->get_type() == token_categories::IDENTIFIER && get_value<identifier>(current_token_) == "max")
+				reduction_op = reduction_categories::MAX;
+			else
+				throw syntax_error("Expected one of '+', '*', 'min' and 'max' in \'reduce\'", current_token_->get_position());
+			get_next_token_();
 
-	std::unique_ptr<ast> parser::parse_unary_()
-	{
+			if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::COLON)
+				throw syntax_error("Expected a ':' after the operator of \'reduce\'", current_token_->get_position());
+			get_next_token_();
+
+			if (current_token_->get_type() != token_categories::IDENTIFIER)
+				throw syntax_error("Expected a identifier in \'reduce\'", current_token_->get_position());
+			reduction_var = get_value<identifier>(current_token_);
+			if (reduction_var == var_name)
+				throw syntax_error("The variable of \'for\' can not be reduced", current_token_->get_position());
+			get_next_token_();
+
+			if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::RBRACKET)
+				throw syntax_error("Expected a ')' after \'reduce\'", current_token_->get_position());
+			get_next_token_();
+		}
+
+		if (current_token_->get_type() != token_categories::KEYWORD || get_value<keyword>(current_token_) != keyword_categories::IN)
+			throw syntax_error("Expected \"in\" between head and body of \'for\'", current_token_->get_position());
+		get_next_token_();
+		
+		auto body = parse_block_();
+		if (!body)
+			return nullptr;
+
+		return std::make_unique<for_expression_ast>(var_name, var_type, std::move(start), std::move(end), std::move(step), std::move(body), parallel, reduction_op, reduction_var, start_row_no);
+	}
+
+	std::unique_ptr<ast> parser::parse_unary_()
+	{
 		if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::USER_DEFINED)
 			return parse_primary_();
 
@@ -403,15 +1014,19 @@ namespace summer_lang
 			switch (get_value<type>(current_token_))
 			{
 			case type_categories::NUMBER:
-				var_type = llvm::Type::getDoubleTy(llvm::getGlobalContext());
+				var_type = llvm::Type::getDoubleTy(global_context->llvm_context);
 				break;
 			case type_categories::STRING:
-				var_type = llvm::Type::getInt8PtrTy(llvm::getGlobalContext());
+				var_type = llvm::Type::getInt8PtrTy(global_context->llvm_context);
+				break;
+			case type_categories::FUTURE:
+				var_type = global_future_type();
 				break;
 			default:
 				throw syntax_error("Unknown type", current_token_->get_position());
 			}
 			get_next_token_();
+			var_type = parse_array_suffix_(var_type);
 
 			if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::ASSIGN)
 				throw syntax_error("Expected initialization of variable" + var_name, current_token_->get_position());
@@ -465,6 +1080,41 @@ namespace summer_lang
 		return std::make_unique<return_ast>(std::move(ret), start_row_no);
 	}
 
+	std::unique_ptr<ast> parser::parse_spawn_()
+	{
+		auto start_row_no = current_token_->get_position();
+		get_next_token_();
+
+		if (current_token_->get_type() != token_categories::IDENTIFIER)
+			throw syntax_error("Expected a call after \'spawn\'", current_token_->get_position());
+		auto expr = parse_identifier_();
+		auto call = dynamic_cast<call_expression_ast *>(expr.get());
+		if (!call)
+			throw syntax_error("Expected a call after \'spawn\'", start_row_no);
+		expr.release();
+		return std::make_unique<spawn_ast>(std::unique_ptr<call_expression_ast>(call), start_row_no);
+	}
+
+	//the count is a number literal or an expression in parentheses, so it can not be taken for the callee
+	std::unique_ptr<ast> parser::parse_bench_()
+	{
+		auto start_row_no = current_token_->get_position();
+		get_next_token_();
+
+		std::unique_ptr<ast> iterations;
+		if (current_token_->get_type() != token_categories::IDENTIFIER)
+			iterations = parse_primary_();
+
+		if (current_token_->get_type() != token_categories::IDENTIFIER)
+			throw syntax_error("Expected a call after \'bench\'", current_token_->get_position());
+		auto expr = parse_identifier_();
+		auto call = dynamic_cast<call_expression_ast *>(expr.get());
+		if (!call)
+			throw syntax_error("Expected a call after \'bench\'", start_row_no);
+		expr.release();
+		return std::make_unique<bench_ast>(std::move(iterations), std::unique_ptr<call_expression_ast>(call), start_row_no);
+	}
+
 	std::unique_ptr<ast> parser::parse_empty_()
 	{
 		auto start_row_no = current_token_->get_position();
@@ -472,6 +1122,21 @@ namespace summer_lang
 		return std::make_unique<empty_ast>(start_row_no);
 	}
 
+	llvm::Type * parser::parse_array_suffix_(llvm::Type * element_type)
+	{
+		if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::LSQUARE)
+			return element_type;
+
+		if (!element_type->isDoubleTy())
+			throw syntax_error("Only arrays of number are supported", current_token_->get_position());
+		get_next_token_();
+
+		if (current_token_->get_type() != token_categories::OPERATOR || get_value<op>(current_token_) != operator_categories::RSQUARE)
+			throw syntax_error("Expected a ']' in array type", current_token_->get_position());
+		get_next_token_();
+		return global_array_type();
+	}
+
 	std::unique_ptr<prototype_ast> parser::parse_prototype_()
 	{
 		std::string name;
@@ -544,15 +1209,19 @@ namespace summer_lang
 				switch (get_value<type>(current_token_))
 				{
 				case type_categories::NUMBER:
-					arg_type = llvm::Type::getDoubleTy(llvm::getGlobalContext());
+					arg_type = llvm::Type::getDoubleTy(global_context->llvm_context);
 					break;
 				case type_categories::STRING:
-					arg_type = llvm::Type::getInt8PtrTy(llvm::getGlobalContext());
+					arg_type = llvm::Type::getInt8PtrTy(global_context->llvm_context);
+					break;
+				case type_categories::FUTURE:
+					arg_type = global_future_type();
 					break;
 				default:
 					throw syntax_error("Unknown type", current_token_->get_position());
 				}
 				get_next_token_();
+				arg_type = parse_array_suffix_(arg_type);
 
 				args.push_back(std::make_pair(arg_name, arg_type));
 
@@ -578,15 +1247,22 @@ namespace summer_lang
 		switch (get_value<type>(current_token_))
 		{
 		case type_categories::NUMBER:
-			ret_type = llvm::Type::getDoubleTy(llvm::getGlobalContext());
+			ret_type = llvm::Type::getDoubleTy(global_context->llvm_context);
 			break;
 		case type_categories::VOID:
-			ret_type = llvm::Type::getVoidTy(llvm::getGlobalContext());
+			ret_type = llvm::Type::getVoidTy(global_context->llvm_context);
+			break;
+		case type_categories::STRING:
+			ret_type = llvm::Type::getInt8PtrTy(global_context->llvm_context);
+			break;
+		case type_categories::FUTURE:
+			ret_type = global_future_type();
 			break;
 		default:
 			throw syntax_error("Unknown type", current_token_->get_position());
 		}
 		get_next_token_();
+		ret_type = parse_array_suffix_(ret_type);
 
 		if (kind && kind != args.size())
 			throw syntax_error("Invalid number of operands of operator", current_token_->get_position());
@@ -598,10 +1274,22 @@ namespace summer_lang
 	{
 		auto start_row_no = current_token_->get_position();
 		get_next_token_();
+
+		auto fast_math = false;
+		if (current_token_->get_type() == token_categories::KEYWORD && get_value<keyword>(current_token_) == keyword_categories::FASTMATH)
+		{
+			fast_math = true;
+			get_next_token_();
+		}
 		
 		auto prototype = parse_prototype_();
 		if (!prototype)
 			return nullptr;
+		if (fast_math)
+			prototype->set_fast_math();
+		//a whole file may be parsed before its operators are compiled, so the precedence is known from here on
+		if (prototype->is_binary_op())
+			op_precedence_[prototype->get_operator_name()] = prototype->get_binary_op_precedence();
 
 		auto body = parse_block_();
 		if (!body)
@@ -620,7 +1308,7 @@ namespace summer_lang
 	std::unique_ptr<function_ast> parser::parse_top_level_expr_()
 	{
 		auto start_row_no = current_token_->get_position();
-		auto prototype = std::make_unique<prototype_ast>("", std::vector<std::pair<std::string, llvm::Type *>>(), llvm::Type::getVoidTy(llvm::getGlobalContext()), false, -1, start_row_no);
+		auto prototype = std::make_unique<prototype_ast>("", std::vector<std::pair<std::string, llvm::Type *>>(), llvm::Type::getVoidTy(global_context->llvm_context), false, -1, start_row_no);
 		auto expression = parse_expression_();
 		if (!expression)
 			return nullptr;
@@ -628,29 +1316,49 @@ namespace summer_lang
 		return std::make_unique<function_ast>(std::move(prototype), std::move(expression), start_row_no);
 	}
 
+	llvm::Value * ast::codegen_condition()
+	{
+		auto value = codegen();
+		if (!value->getType()->isDoubleTy())
+			throw compile_error("Condition must be a number", get_position());
+		return global_context->builder.CreateFCmpONE(value, llvm::ConstantFP::get(global_context->llvm_context, llvm::APFloat(0.0)), "cond");
+	}
+
 	llvm::Value * number_ast::codegen()
 	{
-		return llvm::ConstantFP::get(llvm::getGlobalContext(), llvm::APFloat(value_));
+		return llvm::ConstantFP::get(global_context->llvm_context, llvm::APFloat(value_));
 	}
 
 	llvm::Value * string_ast::codegen()
 	{
-		return global_builder.CreateGlobalStringPtr(value_);
+		return global_context->JIT_helper->get_string_literal(value_);
 	}
 
 	llvm::Value * variable_ast::codegen()
 	{
-		auto ptr = global_named_values.find(name_);
-		if(ptr == global_named_values.end())
+		global_emit_location(this);
+		auto ptr = global_context->named_values.find(name_);
+		if(ptr == global_context->named_values.end())
 			throw compile_error("Unknown variable name \'" + name_ + "\'", get_position());
 		auto info = ptr->second;
-		return global_builder.CreateLoad(info.second, info.first);
+		return global_context->builder.CreateLoad(info.second, info.first);
 	}
 
 	llvm::Value * binary_expression_ast::codegen()
 	{
+		global_emit_location(this);
+		if (op_type_ == operator_categories::ASSIGN)
+		{
+			if (auto element = dynamic_cast<index_ast *>(left_.get()))
+				return element->codegen_store(right_->codegen());
+			if (auto variable = dynamic_cast<variable_ast *>(left_.get()))
+				if (auto dest = codegen_append_(variable))
+					return dest;
+		}
+
 		auto l_value = left_->codegen();
 		auto r_value = right_->codegen();
+		global_emit_location(this);
 
 		if (l_value->getType() != r_value->getType())
 			throw compile_error("Expected same type of operands", get_position());
@@ -658,78 +1366,265 @@ namespace summer_lang
 		switch (op_type_)
 		{
 		case operator_categories::ADD:
-			if(l_value->getType() == llvm::Type::getDoubleTy(llvm::getGlobalContext()))
-				return global_builder.CreateFAdd(l_value, r_value, "addtmp");
+			if(l_value->getType() == llvm::Type::getDoubleTy(global_context->llvm_context))
+				return global_context->builder.CreateFAdd(l_value, r_value, "addtmp");
 			else
 			{
-				auto str_cat = global_JIT_helper->get_function("str_cat");
+				auto str_cat = global_context->JIT_helper->get_function("str_cat");
 				llvm::Value * args[] = { l_value, r_value };
-				return global_builder.CreateCall(str_cat, args, "addtmp");
+				auto result = global_context->builder.CreateCall(str_cat, args, "addtmp");
+				global_release_temporary(l_value);
+				global_release_temporary(r_value);
+				return result;
 			}
 		case operator_categories::SUB:
-			return global_builder.CreateFSub(l_value, r_value, "subtmp");
+			return global_context->builder.CreateFSub(l_value, r_value, "subtmp");
 		case operator_categories::MUL:
-			return global_builder.CreateFMul(l_value, r_value, "multmp");
+			return global_context->builder.CreateFMul(l_value, r_value, "multmp");
 		case operator_categories::DIV:
-			return global_builder.CreateFDiv(l_value, r_value, "divtmp");
+			return global_context->builder.CreateFDiv(l_value, r_value, "divtmp");
 		case operator_categories::LT:
-		{
-			auto tmp = global_builder.CreateFCmpULT(l_value, r_value, "cmptmp");
-			return global_builder.CreateUIToFP(tmp, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "booltmp");
-		}
 		case operator_categories::GT:
-		{
-			auto tmp = global_builder.CreateFCmpUGT(l_value, r_value, "cmptmp");
-			return global_builder.CreateUIToFP(tmp, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "booltmp");
-		}
 		case operator_categories::LE:
-		{
-			auto tmp = global_builder.CreateFCmpULE(l_value, r_value, "cmptmp");
-			return global_builder.CreateUIToFP(tmp, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "booltmp");
-		}
 		case operator_categories::GE:
-		{
-			auto tmp = global_builder.CreateFCmpUGE(l_value, r_value, "cmptmp");
-			return global_builder.CreateUIToFP(tmp, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "booltmp");
-		}
 		case operator_categories::NEQ:
-		{
-			auto tmp = global_builder.CreateFCmpUNE(l_value, r_value, "cmptmp");
-			return global_builder.CreateUIToFP(tmp, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "booltmp");
-		}
 		case operator_categories::EQ:
-		{
-			auto tmp = global_builder.CreateFCmpUEQ(l_value, r_value, "cmptmp");
-			return global_builder.CreateUIToFP(tmp, llvm::Type::getDoubleTy(llvm::getGlobalContext()), "booltmp");
-		}
+			return global_context->builder.CreateUIToFP(codegen_comparison_(l_value, r_value), llvm::Type::getDoubleTy(global_context->llvm_context), "booltmp");
 		case operator_categories::ASSIGN:
 		{
 			auto tmp = dynamic_cast<variable_ast *>(left_.get());
 			if (!tmp)
 				throw compile_error("Destination of \'=\' must be a variable", get_position());
-			auto ptr = global_named_values.find(tmp->get_name());
-			if (ptr == global_named_values.end())
+			auto ptr = global_context->named_values.find(tmp->get_name());
+			if (ptr == global_context->named_values.end())
 				throw syntax_error("Unknown variable name \'" + tmp->get_name() + "'", get_position());
 			auto info = ptr->second;
 			auto dest = info.first;
-			global_builder.CreateStore(r_value, dest);
+			if (global_is_string(r_value))
+				global_store_string(r_value, dest);
+			else
+				global_context->builder.CreateStore(r_value, dest);
 			return dest;
 		}
 		default:
 			break;
 		}
 
-		auto function = global_JIT_helper->get_function("binary" + op_name_);
+		auto function = global_context->JIT_helper->get_function("binary" + op_name_);
 		if (!function)
 			throw compile_error("Unknown operator", get_position());
 
 		llvm::Value * args[] = { l_value, r_value };
-		return global_builder.CreateCall(function, args, "binop");
+		auto result = global_context->builder.CreateCall(function, args, "binop");
+		global_release_temporary(l_value);
+		global_release_temporary(r_value);
+		return result;
+	}
+
+	//'s = s + a + b' appends to the string of 's' in place when nothing else references it,
+	//so building a string in a loop takes amortized linear time instead of copying it every iteration
+	llvm::Value * binary_expression_ast::codegen_append_(const variable_ast * variable)
+	{
+		auto ptr = global_context->named_values.find(variable->get_name());
+		if (ptr == global_context->named_values.end() || ptr->second.second != llvm::Type::getInt8PtrTy(global_context->llvm_context))
+			return nullptr;
+
+		std::vector<ast *> pieces;
+		auto node = right_.get();
+		for (auto add = dynamic_cast<binary_expression_ast *>(node); add && add->op_type_ == operator_categories::ADD; add = dynamic_cast<binary_expression_ast *>(node))
+		{
+			pieces.push_back(add->right_.get());
+			node = add->left_.get();
+		}
+
+		auto base = dynamic_cast<variable_ast *>(node);
+		if (!base || base->get_name() != variable->get_name() || pieces.empty())
+			return nullptr;
+
+		//a piece that borrows the variable itself would see the appended result
+		for (auto piece : pieces)
+		{
+			auto piece_variable = dynamic_cast<variable_ast *>(piece);
+			if (piece_variable && piece_variable->get_name() == variable->get_name())
+				return nullptr;
+		}
+		std::reverse(pieces.begin(), pieces.end());
+
+		std::vector<llvm::Value *> values;
+		for (auto piece : pieces)
+		{
+			values.push_back(piece->codegen());
+			if (!global_is_string(values.back()))
+				throw compile_error("Expected same type of operands", get_position());
+		}
+		global_emit_location(this);
+
+		auto dest = ptr->second.first;
+		auto str_append = global_context->JIT_helper->get_function("str_append");
+		llvm::Value * current_value = global_context->builder.CreateLoad(dest, variable->get_name());
+		for (auto value : values)
+			current_value = global_context->builder.CreateCall(str_append, { current_value, value }, "appendtmp");
+		global_context->builder.CreateStore(current_value, dest);
+
+		for (auto value : values)
+			global_release_temporary(value);
+		return dest;
+	}
+
+	bool binary_expression_ast::is_comparison_() const
+	{
+		switch (op_type_)
+		{
+		case operator_categories::LT:
+		case operator_categories::GT:
+		case operator_categories::LE:
+		case operator_categories::GE:
+		case operator_categories::NEQ:
+		case operator_categories::EQ:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	llvm::Value * binary_expression_ast::codegen_comparison_(llvm::Value * l_value, llvm::Value * r_value)
+	{
+		if (l_value->getType()->isPointerTy())
+		{
+			if (op_type_ != operator_categories::EQ && op_type_ != operator_categories::NEQ)
+				throw compile_error("Only \'==\' and \'<>\' can compare strings", get_position());
+			if (l_value->getType() != llvm::Type::getInt8PtrTy(global_context->llvm_context))
+				throw compile_error("Only strings can be compared", get_position());
+
+			//literals are interned, so two of them are equal exactly when they are the same address
+			if (llvm::isa<llvm::Constant>(l_value) && llvm::isa<llvm::Constant>(r_value))
+				return op_type_ == operator_categories::EQ
+					? global_context->builder.CreateICmpEQ(l_value, r_value, "cmptmp")
+					: global_context->builder.CreateICmpNE(l_value, r_value, "cmptmp");
+
+			llvm::Value * args[] = { l_value, r_value };
+			auto equal = global_context->builder.CreateCall(global_context->JIT_helper->get_function("str_equal"), args, "equal");
+			global_release_temporary(l_value);
+			global_release_temporary(r_value);
+			auto zero = llvm::ConstantInt::get(llvm::Type::getInt32Ty(global_context->llvm_context), 0);
+			return op_type_ == operator_categories::EQ
+				? global_context->builder.CreateICmpNE(equal, zero, "cmptmp")
+				: global_context->builder.CreateICmpEQ(equal, zero, "cmptmp");
+		}
+
+		switch (op_type_)
+		{
+		case operator_categories::LT:
+			return global_context->builder.CreateFCmpULT(l_value, r_value, "cmptmp");
+		case operator_categories::GT:
+			return global_context->builder.CreateFCmpUGT(l_value, r_value, "cmptmp");
+		case operator_categories::LE:
+			return global_context->builder.CreateFCmpULE(l_value, r_value, "cmptmp");
+		case operator_categories::GE:
+			return global_context->builder.CreateFCmpUGE(l_value, r_value, "cmptmp");
+		case operator_categories::NEQ:
+			return global_context->builder.CreateFCmpUNE(l_value, r_value, "cmptmp");
+		case operator_categories::EQ:
+			return global_context->builder.CreateFCmpUEQ(l_value, r_value, "cmptmp");
+		default:
+			assert(false);
+			return nullptr;
+		}
+	}
+
+	llvm::Value * binary_expression_ast::codegen_condition()
+	{
+		if (!is_comparison_())
+			return ast::codegen_condition();
+
+		global_emit_location(this);
+		auto l_value = left_->codegen();
+		auto r_value = right_->codegen();
+		global_emit_location(this);
+
+		if (l_value->getType() != r_value->getType())
+			throw compile_error("Expected same type of operands", get_position());
+		return codegen_comparison_(l_value, r_value);
+	}
+
+	struct math_builtin
+	{
+		const char * name;
+		llvm::Intrinsic::ID id;
+		std::size_t arg_count;
+	};
+
+	//lowered to intrinsics, so the optimizer can fold, hoist and vectorize them like arithmetic
+	static const math_builtin math_builtins[] = {
+		{ "sqrt", llvm::Intrinsic::sqrt, 1 },
+		{ "sin", llvm::Intrinsic::sin, 1 },
+		{ "cos", llvm::Intrinsic::cos, 1 },
+		{ "exp", llvm::Intrinsic::exp, 1 },
+		{ "exp2", llvm::Intrinsic::exp2, 1 },
+		{ "log", llvm::Intrinsic::log, 1 },
+		{ "log2", llvm::Intrinsic::log2, 1 },
+		{ "log10", llvm::Intrinsic::log10, 1 },
+		{ "fabs", llvm::Intrinsic::fabs, 1 },
+		{ "abs", llvm::Intrinsic::fabs, 1 },
+		{ "floor", llvm::Intrinsic::floor, 1 },
+		{ "ceil", llvm::Intrinsic::ceil, 1 },
+		{ "trunc", llvm::Intrinsic::trunc, 1 },
+		{ "round", llvm::Intrinsic::round, 1 },
+		{ "rint", llvm::Intrinsic::rint, 1 },
+		{ "pow", llvm::Intrinsic::pow, 2 },
+		{ "min", llvm::Intrinsic::minnum, 2 },
+		{ "max", llvm::Intrinsic::maxnum, 2 },
+		{ "copysign", llvm::Intrinsic::copysign, 2 },
+		{ "fma", llvm::Intrinsic::fma, 3 },
+	};
+
+	//a user function of the same name wins, unless it is just an 'extern' declaration of the libm function;
+	//calls from a later module only see a declaration, so a body is looked for in every module
+	static const math_builtin * find_math_builtin(const std::string & name, std::size_t arg_count, llvm::Function * function)
+	{
+		if (global_context->JIT_helper->find_definition(name))
+			return nullptr;
+		if (function && !function->getReturnType()->isDoubleTy())
+			return nullptr;
+		if (function)
+			for (auto & arg : function->args())
+				if (!arg.getType()->isDoubleTy())
+					return nullptr;
+
+		for (auto & builtin : math_builtins)
+			if (builtin.name == name && builtin.arg_count == arg_count)
+				return &builtin;
+		return nullptr;
 	}
 
 	llvm::Value * call_expression_ast::codegen()
 	{
-		auto callee_function = global_JIT_helper->get_function(callee_);
+		global_emit_location(this);
+		auto callee_function = global_context->JIT_helper->get_function(callee_);
+		if (auto builtin = find_math_builtin(callee_, args_.size(), callee_function))
+		{
+			std::vector<llvm::Value *> args_value;
+			for (auto & arg : args_)
+			{
+				args_value.push_back(arg->codegen());
+				if (!args_value.back()->getType()->isDoubleTy())
+					throw compile_error("Expected a number in \'" + callee_ + "\'", get_position());
+			}
+			global_emit_location(this);
+
+			auto module = global_context->builder.GetInsertBlock()->getModule();
+			auto intrinsic = llvm::Intrinsic::getDeclaration(module, builtin->id, { llvm::Type::getDoubleTy(global_context->llvm_context) });
+			return global_context->builder.CreateCall(intrinsic, args_value, callee_ + "tmp");
+		}
+
+		if (!callee_function && callee_ == "length" && args_.size() == 1)
+		{
+			auto array = args_[0]->codegen();
+			if (array->getType() != global_array_type())
+				throw compile_error("Expected an array in \'length\'", get_position());
+			return global_context->builder.CreateSIToFP(global_array_length(array), llvm::Type::getDoubleTy(global_context->llvm_context), "lengthtmp");
+		}
+
 		if (!callee_function)
 			throw compile_error("Unknown function referenced", get_position());
 
@@ -743,10 +1638,153 @@ namespace summer_lang
 			if (!args_value.back())
 				return nullptr;
 		}
+		global_emit_location(this);
 
-		return global_builder.CreateCall(callee_function, args_value);
+		//arguments are borrowed by the callee
+		auto result = global_context->builder.CreateCall(callee_function, args_value);
+		for (auto value : args_value)
+			global_release_temporary(value);
+		return result;
 	}
 	
+	llvm::Function * deferred_call_ast::get_callee_() const
+	{
+		auto callee_function = global_context->JIT_helper->get_function(call_->get_callee());
+		if (!callee_function)
+			throw compile_error("Unknown function referenced", get_position());
+		if (!callee_function->getReturnType()->isDoubleTy() && !callee_function->getReturnType()->isVoidTy())
+			throw compile_error("Only functions returning number or void can be spawned or benchmarked", get_position());
+		if (callee_function->arg_size() != call_->get_args().size())
+			throw compile_error("Incorrect number of arguments passed", get_position());
+		return callee_function;
+	}
+
+	llvm::AllocaInst * deferred_call_ast::codegen_env_(llvm::Function * callee, bool retain_strings, std::vector<llvm::Value *> & args_value)
+	{
+		std::vector<llvm::Type *> field_types;
+		auto param = callee->arg_begin();
+		for (auto & arg : call_->get_args())
+		{
+			auto value = arg->codegen();
+			if (value->getType() != param->getType())
+				throw compile_error("Incorrect type of argument passed to \'" + call_->get_callee() + "\'", arg->get_position());
+			if (retain_strings && global_is_string(value) && !global_is_owned(value))
+				value = global_retain(value);
+			args_value.push_back(value);
+			field_types.push_back(value->getType());
+			++param;
+		}
+		global_emit_location(this);
+
+		auto env_type = llvm::StructType::get(global_context->llvm_context, field_types);
+		auto env = global_create_alloca(global_context->builder.GetInsertBlock()->getParent(), "env", env_type);
+		for (unsigned i = 0; i != args_value.size(); ++i)
+			global_context->builder.CreateStore(args_value[i], global_context->builder.CreateStructGEP(env_type, env, i));
+		return env;
+	}
+
+	//the thunk unpacks the arguments from 'env' and makes the call, the builder is left where it was
+	llvm::Function * deferred_call_ast::codegen_thunk_(llvm::Function * callee, llvm::StructType * env_type, bool release_strings)
+	{
+		auto & context = global_context->llvm_context;
+		auto double_type = llvm::Type::getDoubleTy(context);
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
+		auto saved_insert_point = global_context->builder.saveIP();
+
+		auto function_type = llvm::FunctionType::get(double_type, { llvm::Type::getInt8PtrTy(context) }, false);
+		auto function = llvm::Function::Create(function_type, llvm::Function::InternalLinkage, parent->getName() + ".thunk", parent->getParent());
+		auto env_arg = &*function->arg_begin();
+		env_arg->setName("env");
+
+		global_context->builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+		auto info = global_context->JIT_helper->get_debug_info();
+		if (info)
+		{
+			info->begin_function(function, function->getName().str(), get_position());
+			info->emit_location(global_context->builder, get_position());
+		}
+
+		auto env = global_context->builder.CreateBitCast(env_arg, env_type->getPointerTo(), "env");
+		std::vector<llvm::Value *> args_value;
+		for (unsigned i = 0; i != env_type->getNumElements(); ++i)
+			args_value.push_back(global_context->builder.CreateLoad(global_context->builder.CreateStructGEP(env_type, env, i)));
+
+		auto result = global_context->builder.CreateCall(callee, args_value);
+		if (release_strings)
+			for (auto value : args_value)
+				if (global_is_string(value))
+					global_release(value);
+
+		if (callee->getReturnType()->isVoidTy())
+			global_context->builder.CreateRet(llvm::ConstantFP::get(double_type, 0.0));
+		else
+			global_context->builder.CreateRet(result);
+
+		if (info)
+			info->end_function(global_context->builder);
+		llvm::verifyFunction(*function);
+
+		global_context->builder.restoreIP(saved_insert_point);
+		global_emit_location(this);
+		return function;
+	}
+
+	bool deferred_call_ast::modifies(const std::string & name) const
+	{
+		return call_->modifies(name);
+	}
+
+	llvm::Value * spawn_ast::codegen()
+	{
+		global_emit_location(this);
+		auto callee_function = get_callee_();
+
+		//the spawned call owns a reference to each string argument, the caller may release its own before the call starts
+		std::vector<llvm::Value *> args_value;
+		auto env = codegen_env_(callee_function, true, args_value);
+		auto env_type = llvm::cast<llvm::StructType>(env->getAllocatedType());
+		auto thunk = codegen_thunk_(callee_function, env_type, true);
+
+		//the runtime copies the arguments, since the call may start after this function has returned
+		auto int8_ptr_type = llvm::Type::getInt8PtrTy(global_context->llvm_context);
+		auto size = llvm::ConstantExpr::getSizeOf(env_type);
+		llvm::Value * spawn_args[] = { global_context->builder.CreateBitCast(thunk, int8_ptr_type), global_context->builder.CreateBitCast(env, int8_ptr_type), size };
+		return global_context->builder.CreateCall(global_context->JIT_helper->get_function("spawn"), spawn_args, "future");
+	}
+
+	llvm::Value * bench_ast::codegen()
+	{
+		auto & context = global_context->llvm_context;
+		auto double_type = llvm::Type::getDoubleTy(context);
+		global_emit_location(this);
+		auto callee_function = get_callee_();
+
+		llvm::Value * iterations = llvm::ConstantFP::get(double_type, 0.0);
+		if (iterations_)
+		{
+			iterations = iterations_->codegen();
+			if (iterations->getType() != double_type)
+				throw compile_error("Expected a number of iterations after \'bench\'", iterations_->get_position());
+		}
+
+		//the measured calls borrow the arguments, which stay alive until 'bench' returns
+		std::vector<llvm::Value *> args_value;
+		auto env = codegen_env_(callee_function, false, args_value);
+		auto thunk = codegen_thunk_(callee_function, llvm::cast<llvm::StructType>(env->getAllocatedType()), false);
+
+		auto int8_ptr_type = llvm::Type::getInt8PtrTy(context);
+		llvm::Value * bench_args[] = { global_context->builder.CreateBitCast(thunk, int8_ptr_type), global_context->builder.CreateBitCast(env, int8_ptr_type), iterations, global_context->JIT_helper->get_string_literal(call_->get_callee()) };
+		auto result = global_context->builder.CreateCall(global_context->JIT_helper->get_function("bench"), bench_args, "bench");
+		for (auto value : args_value)
+			global_release_temporary(value);
+		return result;
+	}
+
+	bool bench_ast::modifies(const std::string & name) const
+	{
+		return (iterations_ && iterations_->modifies(name)) || deferred_call_ast::modifies(name);
+	}
+
 	llvm::Function * prototype_ast::codegen()
 	{
 		std::vector<llvm::Type *> args_type;
@@ -754,14 +1792,24 @@ namespace summer_lang
 			args_type.push_back(arg.second);
 
 		auto function_type = llvm::FunctionType::get(ret_type_, args_type, false);
-		auto module = global_JIT_helper->get_module_for_new_function();
+		auto module = name_.empty() ? global_context->JIT_helper->get_module_for_anonymous_function() : global_context->JIT_helper->get_module_for_new_function();
 
 		auto function_name = MCJIT_helper::generate_function_name(name_);
+		if (name_.empty())
+		{
+			//the anonymous module holds one expression at a time, a function left under its name belongs to one that failed
+			if (auto stale = module->getFunction(function_name))
+			{
+				stale->dropAllReferences();
+				stale->eraseFromParent();
+			}
+		}
+
 		auto function = llvm::Function::Create(function_type, llvm::Function::ExternalLinkage, function_name, module);
-		if (function->getName() != function_name)
+		if (!name_.empty() && function->getName() != function_name)
 		{
 			function->eraseFromParent();
-			function = global_JIT_helper->get_function(name_);
+			function = global_context->JIT_helper->get_function(name_);
 			if (!function->empty())
 				throw compile_error("Redefinition of function " + name_, get_position());
 			if (function->arg_size() != args_.size())
@@ -775,9 +1823,31 @@ namespace summer_lang
 		return function;
 	}
 	
+	//a definition that fails half-way must not stay in its module, or compiling the module would fail as well;
+	//the REPL goes on after errors, and a later definition of the same name must be possible
+	static void discard_definition(llvm::Function * function, const std::set<llvm::Function *> & existing)
+	{
+		std::vector<llvm::Function *> outlined;
+		for (auto & other : *function->getParent())
+			if (&other != function && !existing.count(&other) && !other.isDeclaration())
+				outlined.push_back(&other);
+
+		function->deleteBody();
+		for (auto other : outlined)
+			other->dropAllReferences();
+		for (auto other : outlined)
+			other->eraseFromParent();
+
+		global_context->builder.ClearInsertionPoint();
+		global_context->tail_recursion_block = nullptr;
+		global_context->in_parallel_body = false;
+	}
+
 	llvm::Function * function_ast::codegen()
 	{
-		global_named_values.clear();
+		global_context->named_values.clear();
+		global_context->induction_values.clear();
+		global_context->safe_indices.clear();
 
 		auto function = prototype_->codegen();
 		if (!function)
@@ -786,21 +1856,92 @@ namespace summer_lang
 		if (prototype_->is_binary_op())
 			set_op_precedence(prototype_->get_operator_name(), prototype_->get_binary_op_precedence());
 
-		auto basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", function);
-		global_builder.SetInsertPoint(basic_block);
+		std::set<llvm::Function *> existing;
+		for (auto & other : *function->getParent())
+			existing.insert(&other);
+
+		try
+		{
+			return codegen_body_(function);
+		}
+		catch (...)
+		{
+			discard_definition(function, existing);
+			//an anonymous function is not kept as a declaration either, the next expression reuses its name
+			if (prototype_->get_name().empty())
+				function->eraseFromParent();
+			throw;
+		}
+	}
+
+	llvm::Function * function_ast::codegen_body_(llvm::Function * function)
+	{
+		auto basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "entry", function);
+		global_context->builder.SetInsertPoint(basic_block);
 
-		global_named_values.clear();
+		//reductions can only be reassociated, and so vectorized, when the arithmetic is not strict IEEE
+		llvm::FastMathFlags fast_math_flags;
+		if (prototype_->is_fast_math() || global_context->JIT_helper->is_fast_math())
+		{
+			fast_math_flags.setUnsafeAlgebra();
+			function->addFnAttr("unsafe-fp-math", "true");
+			function->addFnAttr("no-nans-fp-math", "true");
+			function->addFnAttr("no-infs-fp-math", "true");
+		}
+		global_context->builder.SetFastMathFlags(fast_math_flags);
+
+		auto info = global_context->JIT_helper->get_debug_info();
+		if (info)
+		{
+			info->begin_function(function, MCJIT_helper::generate_function_name(prototype_->get_name()), get_position());
+			info->emit_location(global_context->builder, get_position());
+		}
+
+		global_context->named_values.clear();
+		global_context->argument_slots.clear();
+		global_context->string_slots.clear();
 		for (auto & arg : function->args())
 		{
 			auto alloca_inst = global_create_alloca(function, arg.getName(), arg.getType());
-			global_builder.CreateStore(&arg, alloca_inst);
-			global_named_values[arg.getName()].first = alloca_inst;
-			global_named_values[arg.getName()].second = arg.getType();
+			if (global_is_string(&arg))
+			{
+				global_context->builder.CreateStore(global_retain(&arg), alloca_inst);
+				global_context->string_slots.push_back(alloca_inst);
+			}
+			else
+				global_context->builder.CreateStore(&arg, alloca_inst);
+			global_context->named_values[arg.getName()].first = alloca_inst;
+			global_context->named_values[arg.getName()].second = arg.getType();
+			global_context->argument_slots.push_back(alloca_inst);
+		}
+
+		//self-recursive calls in tail position jump back here instead of growing the stack
+		global_context->tail_recursion_block = llvm::BasicBlock::Create(global_context->llvm_context, "tailrecurse", function);
+		global_context->builder.CreateBr(global_context->tail_recursion_block);
+		global_context->builder.SetInsertPoint(global_context->tail_recursion_block);
+
+		auto body_value = body_->codegen();
+		if (echo_ && body_value && !global_context->builder.GetInsertBlock()->getTerminator() && !dynamic_cast<for_expression_ast *>(body_.get()))
+		{
+			if (body_value->getType()->isDoubleTy())
+				global_context->builder.CreateCall(global_context->JIT_helper->get_function("echo_number"), { body_value });
+			else if (global_is_string(body_value))
+				global_context->builder.CreateCall(global_context->JIT_helper->get_function("echo_string"), { body_value });
+		}
+		global_release_temporary(body_value);
+		global_context->tail_recursion_block = nullptr;
+
+		if (!global_context->builder.GetInsertBlock()->getTerminator())
+		{
+			global_release_slots(0);
+			if (function->getReturnType()->isVoidTy())
+				global_context->builder.CreateRetVoid();
+			else
+				global_context->builder.CreateRet(llvm::Constant::getNullValue(function->getReturnType()));
 		}
 
-		body_->codegen();
-		if(function->getReturnType()->isVoidTy())
-			global_builder.CreateRetVoid();
+		if (info)
+			info->end_function(global_context->builder);
 
 		llvm::verifyFunction(*function);
 		return function;
@@ -808,79 +1949,147 @@ namespace summer_lang
 
 	llvm::Value * if_expression_ast::codegen()
 	{
-		auto cond_value = cond_->codegen();
+		global_emit_location(this);
+		auto cond_value = cond_->codegen_condition();
 		if (!cond_value)
 			return nullptr;
 
-		cond_value = global_builder.CreateFCmpONE(cond_value, llvm::ConstantFP::get(llvm::getGlobalContext(), llvm::APFloat(0.0)), "ifcond");
-		auto parent = global_builder.GetInsertBlock()->getParent();
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
 
-		auto then_basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "then", parent);
-		auto else_basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "else");
-		auto merge_basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "merge");
+		auto then_basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "then", parent);
+		auto else_basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "else");
+		auto merge_basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "merge");
 
-		global_builder.CreateCondBr(cond_value, then_basic_block, else_basic_block);
-		global_builder.SetInsertPoint(then_basic_block);
+		global_context->builder.CreateCondBr(cond_value, then_basic_block, else_basic_block);
+		global_context->builder.SetInsertPoint(then_basic_block);
 		
 		auto then_value = then_part_->codegen();
 		if (!then_value)
 			return nullptr;
 		
-		global_builder.CreateBr(merge_basic_block);
-		then_basic_block = global_builder.GetInsertBlock();
+		global_context->builder.CreateBr(merge_basic_block);
+		then_basic_block = global_context->builder.GetInsertBlock();
 
 		parent->getBasicBlockList().push_back(else_basic_block);
-		global_builder.SetInsertPoint(else_basic_block);
+		global_context->builder.SetInsertPoint(else_basic_block);
 
 		auto else_value = else_part_->codegen();
 		if (!else_value)
 			return nullptr;
 
-		global_builder.CreateBr(merge_basic_block);
-		else_basic_block = global_builder.GetInsertBlock();
+		global_context->builder.CreateBr(merge_basic_block);
+		else_basic_block = global_context->builder.GetInsertBlock();
 
 		parent->getBasicBlockList().push_back(merge_basic_block);
-		global_builder.SetInsertPoint(merge_basic_block);
+		global_context->builder.SetInsertPoint(merge_basic_block);
 
-		auto PHI_node = global_builder.CreatePHI(llvm::Type::getDoubleTy(llvm::getGlobalContext()), 2, "iftmp");
+		//an 'if' used as a statement has nothing to merge, owned strings are dropped in their arms
+		//otherwise both arms hand an owned string to the merge
+		auto is_statement = then_value->getType() != else_value->getType() || then_value->getType()->isVoidTy();
+		for (auto arm : { std::make_pair(&then_value, then_basic_block), std::make_pair(&else_value, else_basic_block) })
+		{
+			if (!global_is_string(*arm.first))
+				continue;
+
+			global_context->builder.SetInsertPoint(arm.second->getTerminator());
+			if (is_statement)
+				global_release_temporary(*arm.first);
+			else if (!global_is_owned(*arm.first))
+				*arm.first = global_retain(*arm.first);
+		}
+		global_context->builder.SetInsertPoint(merge_basic_block);
+
+		if (is_statement)
+			return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(global_context->llvm_context));
+
+		auto PHI_node = global_context->builder.CreatePHI(then_value->getType(), 2, "iftmp");
 		PHI_node->addIncoming(then_value, then_basic_block);
 		PHI_node->addIncoming(else_value, else_basic_block);
 		return PHI_node;
 	}
 
+	static bool is_integral(const ast * node)
+	{
+		auto number = dynamic_cast<const number_ast *>(node);
+		return number && std::floor(number->get_value()) == number->get_value() && std::fabs(number->get_value()) < 9007199254740992.0;
+	}
+
+	binary_expression_ast * for_expression_ast::get_counted_bound_() const
+	{
+		if (!var_type_->isDoubleTy() || !is_integral(start_.get()) || !is_integral(step_.get()))
+			return nullptr;
+		if (static_cast<number_ast *>(step_.get())->get_value() <= 0)
+			return nullptr;
+
+		auto bound = dynamic_cast<binary_expression_ast *>(end_.get());
+		if (!bound || (bound->get_op_type() != operator_categories::LT && bound->get_op_type() != operator_categories::LE))
+			return nullptr;
+
+		auto variable = dynamic_cast<variable_ast *>(bound->get_left());
+		if (!variable || variable->get_name() != var_name_)
+			return nullptr;
+
+		if (bound->get_right()->modifies(var_name_) || body_->modifies(var_name_))
+			return nullptr;
+		return bound;
+	}
+
 	llvm::Value * for_expression_ast::codegen()
 	{
-		auto parent = global_builder.GetInsertBlock()->getParent();
+		global_emit_location(this);
+		if (parallel_)
+			return codegen_parallel_();
+		if (reduction_var_.empty())
+			return codegen_serial_();
+
+		//the body accumulates into a partial result of its own, which is folded into the variable after the loop
+		auto target = get_reduction_target_();
+		auto partial = codegen_partial_(global_context->builder.GetInsertBlock()->getParent());
+		auto result = codegen_serial_();
+		global_context->named_values[reduction_var_] = target;
+		if (!result)
+			return nullptr;
+
+		mark_reduction_(partial);
+		global_context->builder.CreateStore(codegen_combine_(global_context->builder.CreateLoad(target.first), global_context->builder.CreateLoad(partial)), target.first);
+		return result;
+	}
+
+	llvm::Value * for_expression_ast::codegen_serial_()
+	{
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
 		auto alloca_inst = global_create_alloca(parent, var_name_, var_type_);
 
-		auto old_val = global_named_values[var_name_];
-		global_named_values[var_name_].first = alloca_inst;
-		global_named_values[var_name_].second = var_type_;
+		auto old_val = global_context->named_values[var_name_];
+		global_context->named_values[var_name_].first = alloca_inst;
+		global_context->named_values[var_name_].second = var_type_;
+
+		if (auto bound = get_counted_bound_())
+			return codegen_counted_(bound, alloca_inst, old_val);
 		
 		auto start_value = start_->codegen();
 		if (!start_value)
 			return nullptr;
 
-		global_builder.CreateStore(start_value, alloca_inst);
+		global_context->builder.CreateStore(start_value, alloca_inst);
 
-		auto parent_basic_block = global_builder.GetInsertBlock();
-		auto cmp_basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "cmp", parent);
-		auto body_basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "body");
-		auto after_basic_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "after");
+		auto parent_basic_block = global_context->builder.GetInsertBlock();
+		auto cmp_basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "cmp", parent);
+		auto body_basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "body");
+		auto after_basic_block = llvm::BasicBlock::Create(global_context->llvm_context, "after");
 
-		global_builder.CreateBr(cmp_basic_block);
+		global_context->builder.CreateBr(cmp_basic_block);
 
-		global_builder.SetInsertPoint(cmp_basic_block);	
-		auto end_cond = end_->codegen();												  
+		global_context->builder.SetInsertPoint(cmp_basic_block);	
+		auto end_cond = end_->codegen_condition();
 		if (!end_cond)
-			return false;
+			return nullptr;
 
-		end_cond = global_builder.CreateFCmpONE(end_cond, llvm::ConstantFP::get(llvm::getGlobalContext(), llvm::APFloat(0.0)), "loop_cond");
-		global_builder.CreateCondBr(end_cond, body_basic_block, after_basic_block);
-		cmp_basic_block = global_builder.GetInsertBlock();
+		global_context->builder.CreateCondBr(end_cond, body_basic_block, after_basic_block);
+		cmp_basic_block = global_context->builder.GetInsertBlock();
 
 		parent->getBasicBlockList().push_back(body_basic_block);
-		global_builder.SetInsertPoint(body_basic_block);
+		global_context->builder.SetInsertPoint(body_basic_block);
 		if (!body_->codegen())
 			return nullptr;
 
@@ -888,27 +2097,390 @@ namespace summer_lang
 		if (!step_value)
 			return nullptr;
 
-		auto current_value = global_builder.CreateLoad(alloca_inst);
-		auto next_value = global_builder.CreateFAdd(current_value, step_value, "next_var");
-		global_builder.CreateStore(next_value, alloca_inst);
-		global_builder.CreateBr(cmp_basic_block);
-		body_basic_block = global_builder.GetInsertBlock();
+		auto current_value = global_context->builder.CreateLoad(alloca_inst);
+		auto next_value = global_context->builder.CreateFAdd(current_value, step_value, "next_var");
+		global_context->builder.CreateStore(next_value, alloca_inst);
+		global_context->builder.CreateBr(cmp_basic_block);
+		body_basic_block = global_context->builder.GetInsertBlock();
+
+		parent->getBasicBlockList().push_back(after_basic_block);
+		global_context->builder.SetInsertPoint(after_basic_block);
+
+		if (old_val.first)
+			global_context->named_values[var_name_] = old_val;
+		else
+			global_context->named_values.erase(var_name_);
+		after_basic_block = global_context->builder.GetInsertBlock();
+
+		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(global_context->llvm_context));
+	}
+
+	//a loop with integral start and step that runs while 'var < bound' counts with an integer induction variable,
+	//so the loop passes can compute its trip count and vectorize it
+	llvm::Value * for_expression_ast::codegen_counted_(binary_expression_ast * bound, llvm::AllocaInst * alloca_inst, std::pair<llvm::AllocaInst *, llvm::Type *> old_val)
+	{
+		auto & context = global_context->llvm_context;
+		auto int64_type = llvm::Type::getInt64Ty(context);
+		auto double_type = llvm::Type::getDoubleTy(context);
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
+
+		auto start = static_cast<std::int64_t>(static_cast<number_ast *>(start_.get())->get_value());
+		auto step = static_cast<std::int64_t>(static_cast<number_ast *>(step_.get())->get_value());
+		auto is_less = bound->get_op_type() == operator_categories::LT;
+
+		auto induction_inst = global_create_alloca(parent, var_name_ + ".iv", int64_type);
+		global_context->builder.CreateStore(llvm::ConstantInt::get(int64_type, start, true), induction_inst);
+
+		auto old_induction = global_context->induction_values.find(var_name_) == global_context->induction_values.end() ? nullptr : global_context->induction_values[var_name_];
+		global_context->induction_values[var_name_] = induction_inst;
+
+		//'for i = 0, i < length(a) in ... a[i] ...' never leaves the bounds of 'a' while 'a' keeps its value
+		auto array = global_length_query(bound->get_right());
+		auto safe_index = false;
+		if (array && start >= 0 && is_less && !body_->modifies(array->get_name()))
+			safe_index = global_context->safe_indices.insert(std::make_pair(var_name_, array->get_name())).second;
+
+		auto cmp_basic_block = llvm::BasicBlock::Create(context, "cmp", parent);
+		auto body_basic_block = llvm::BasicBlock::Create(context, "body");
+		auto after_basic_block = llvm::BasicBlock::Create(context, "after");
+
+		global_context->builder.CreateBr(cmp_basic_block);
+		global_context->builder.SetInsertPoint(cmp_basic_block);
+
+		llvm::Value * end_cond;
+		if (array)
+		{
+			auto array_value = array->codegen();
+			if (array_value->getType() != global_array_type())
+				throw compile_error("Expected an array in 'length'", bound->get_position());
+			auto limit = global_array_length(array_value);
+			auto current_value = global_context->builder.CreateLoad(induction_inst, var_name_);
+			end_cond = is_less
+				? global_context->builder.CreateICmpSLT(current_value, limit, "loop_cond")
+				: global_context->builder.CreateICmpSLE(current_value, limit, "loop_cond");
+		}
+		else
+		{
+			auto limit = bound->get_right()->codegen();
+			if (limit->getType() != double_type)
+				throw compile_error("Expected same type of operands", bound->get_position());
+			auto current_value = global_context->builder.CreateSIToFP(global_context->builder.CreateLoad(induction_inst, var_name_), double_type);
+			end_cond = is_less
+				? global_context->builder.CreateFCmpOLT(current_value, limit, "loop_cond")
+				: global_context->builder.CreateFCmpOLE(current_value, limit, "loop_cond");
+		}
+		global_context->builder.CreateCondBr(end_cond, body_basic_block, after_basic_block);
+
+		parent->getBasicBlockList().push_back(body_basic_block);
+		global_context->builder.SetInsertPoint(body_basic_block);
+
+		auto current_value = global_context->builder.CreateLoad(induction_inst, var_name_);
+		global_context->builder.CreateStore(global_context->builder.CreateSIToFP(current_value, double_type), alloca_inst);
+		if (!body_->codegen())
+			return nullptr;
+
+		current_value = global_context->builder.CreateLoad(induction_inst, var_name_);
+		auto next_value = global_context->builder.CreateNSWAdd(current_value, llvm::ConstantInt::get(int64_type, step, true), "next_var");
+		global_context->builder.CreateStore(next_value, induction_inst);
+		global_context->builder.CreateBr(cmp_basic_block);
 
 		parent->getBasicBlockList().push_back(after_basic_block);
-		global_builder.SetInsertPoint(after_basic_block);
+		global_context->builder.SetInsertPoint(after_basic_block);
+
+		if (safe_index)
+			global_context->safe_indices.erase(std::make_pair(var_name_, array->get_name()));
+		if (old_induction)
+			global_context->induction_values[var_name_] = old_induction;
+		else
+			global_context->induction_values.erase(var_name_);
 
 		if (old_val.first)
-			global_named_values[var_name_] = old_val;
+			global_context->named_values[var_name_] = old_val;
 		else
-			global_named_values.erase(var_name_);
-		after_basic_block = global_builder.GetInsertBlock();
+			global_context->named_values.erase(var_name_);
+
+		return llvm::Constant::getNullValue(double_type);
+	}
+
+	std::pair<llvm::AllocaInst *, llvm::Type *> for_expression_ast::get_reduction_target_() const
+	{
+		auto target = global_context->named_values.find(reduction_var_);
+		if (target == global_context->named_values.end() || !target->second.first)
+			throw compile_error("Unknown variable \'" + reduction_var_ + "\' in \'reduce\'", get_position());
+		if (!target->second.second->isDoubleTy())
+			throw compile_error("\'reduce\' needs a variable of type number", get_position());
+		return target->second;
+	}
+
+	//inside the loop the name of the variable refers to the partial result, which starts at the identity of the operator
+	llvm::AllocaInst * for_expression_ast::codegen_partial_(llvm::Function * function)
+	{
+		auto double_type = llvm::Type::getDoubleTy(global_context->llvm_context);
+		auto partial = global_create_alloca(function, reduction_var_ + ".partial", double_type);
+		global_context->builder.CreateStore(llvm::ConstantFP::get(double_type, reduction_identity(reduction_op_)), partial);
+		global_context->named_values[reduction_var_] = std::make_pair(partial, double_type);
+		return partial;
+	}
+
+	//'reduce' allows reassociating the updates of the partial result, which lets the loop vectorizer keep one per lane
+	void for_expression_ast::mark_reduction_(llvm::AllocaInst * partial) const
+	{
+		for (auto user : partial->users())
+		{
+			auto store = llvm::dyn_cast<llvm::StoreInst>(user);
+			if (!store || store->getPointerOperand() != partial)
+				continue;
+
+			auto update = llvm::dyn_cast<llvm::BinaryOperator>(store->getValueOperand());
+			if (update && ((reduction_op_ == reduction_categories::ADD && update->getOpcode() == llvm::Instruction::FAdd)
+				|| (reduction_op_ == reduction_categories::MUL && update->getOpcode() == llvm::Instruction::FMul)))
+				update->setHasUnsafeAlgebra(true);
+			else if (reduction_op_ == reduction_categories::MIN || reduction_op_ == reduction_categories::MAX)
+				relax_min_max_(partial, store);
+		}
+	}
+
+	//the vectorizer only knows min and max reductions as a compare and a select, in functions marked as free of NaNs.
+	//'acc = min(acc, x)' becomes 'acc = x < acc ? x : acc', which, like minnum, keeps the partial result when x is NaN;
+	//the mark lets the backend assume no NaNs in the rest of the function as well, as fast-math does
+	void for_expression_ast::relax_min_max_(llvm::AllocaInst * partial, llvm::StoreInst * store) const
+	{
+		auto call = llvm::dyn_cast<llvm::CallInst>(store->getValueOperand());
+		auto callee = call ? call->getCalledFunction() : nullptr;
+		auto id = reduction_op_ == reduction_categories::MIN ? llvm::Intrinsic::minnum : llvm::Intrinsic::maxnum;
+		if (!callee || callee->getIntrinsicID() != id)
+			return;
 
-		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(llvm::getGlobalContext()));
+		auto is_partial = [partial](llvm::Value * value)
+		{
+			auto load = llvm::dyn_cast<llvm::LoadInst>(value);
+			return load && load->getPointerOperand() == partial;
+		};
+		auto accumulated = call->getArgOperand(0), operand = call->getArgOperand(1);
+		if (!is_partial(accumulated))
+			std::swap(accumulated, operand);
+		if (!is_partial(accumulated))
+			return;
+
+		llvm::IRBuilder<> builder(call);
+		builder.SetCurrentDebugLocation(call->getDebugLoc());
+		auto compare = reduction_op_ == reduction_categories::MIN ? builder.CreateFCmpOLT(operand, accumulated) : builder.CreateFCmpOGT(operand, accumulated);
+		auto select = builder.CreateSelect(compare, operand, accumulated, "reduce");
+		call->replaceAllUsesWith(select);
+		call->eraseFromParent();
+		store->getParent()->getParent()->addFnAttr("no-nans-fp-math", "true");
+	}
+
+	llvm::Value * for_expression_ast::codegen_combine_(llvm::Value * left, llvm::Value * right) const
+	{
+		auto module = global_context->builder.GetInsertBlock()->getParent()->getParent();
+		auto double_type = llvm::Type::getDoubleTy(global_context->llvm_context);
+		switch (reduction_op_)
+		{
+		case reduction_categories::MUL:
+			return global_context->builder.CreateFMul(left, right, "reduce");
+		case reduction_categories::MIN:
+			return global_context->builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::minnum, { double_type }), { left, right }, "reduce");
+		case reduction_categories::MAX:
+			return global_context->builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::maxnum, { double_type }), { left, right }, "reduce");
+		default:
+			return global_context->builder.CreateFAdd(left, right, "reduce");
+		}
+	}
+
+	//the body runs for the iterations [lo, hi) of the loop, the variables of the enclosing function are read from 'env'
+	llvm::Function * for_expression_ast::codegen_parallel_body_(binary_expression_ast * bound, llvm::StructType * env_type, const std::vector<std::pair<std::string, llvm::Type *>> & captures)
+	{
+		auto & context = global_context->llvm_context;
+		auto int64_type = llvm::Type::getInt64Ty(context);
+		auto double_type = llvm::Type::getDoubleTy(context);
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
+
+		auto start = static_cast<std::int64_t>(static_cast<number_ast *>(start_.get())->get_value());
+		auto step = static_cast<std::int64_t>(static_cast<number_ast *>(step_.get())->get_value());
+
+		auto return_type = reduction_var_.empty() ? llvm::Type::getVoidTy(context) : double_type;
+		auto function_type = llvm::FunctionType::get(return_type, { llvm::Type::getInt8PtrTy(context), int64_type, int64_type }, false);
+		auto function = llvm::Function::Create(function_type, llvm::Function::InternalLinkage, parent->getName() + ".parallel", parent->getParent());
+		auto arg = function->arg_begin();
+		auto env_arg = &*arg++;
+		auto lo_arg = &*arg++;
+		auto hi_arg = &*arg;
+		env_arg->setName("env");
+		lo_arg->setName("lo");
+		hi_arg->setName("hi");
+
+		global_context->builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+		auto info = global_context->JIT_helper->get_debug_info();
+		if (info)
+		{
+			info->begin_function(function, function->getName().str(), get_position());
+			info->emit_location(global_context->builder, get_position());
+		}
+
+		auto env = global_context->builder.CreateBitCast(env_arg, env_type->getPointerTo(), "env");
+		for (unsigned i = 0; i != captures.size(); ++i)
+		{
+			auto alloca_inst = global_create_alloca(function, captures[i].first, captures[i].second);
+			global_context->builder.CreateStore(global_context->builder.CreateLoad(global_context->builder.CreateStructGEP(env_type, env, i)), alloca_inst);
+			global_context->named_values[captures[i].first] = std::make_pair(alloca_inst, captures[i].second);
+		}
+
+		auto partial = reduction_var_.empty() ? nullptr : codegen_partial_(function);
+
+		auto alloca_inst = global_create_alloca(function, var_name_, double_type);
+		auto induction_inst = global_create_alloca(function, var_name_ + ".iv", int64_type);
+		global_context->named_values[var_name_] = std::make_pair(alloca_inst, double_type);
+		global_context->induction_values[var_name_] = induction_inst;
+
+		//the bound was evaluated once by the caller, so 'a' can not change while the loop runs
+		auto array = global_length_query(bound->get_right());
+		if (array && start >= 0 && bound->get_op_type() == operator_categories::LT)
+			global_context->safe_indices.insert(std::make_pair(var_name_, array->get_name()));
+
+		auto first_value = global_context->builder.CreateNSWAdd(llvm::ConstantInt::get(int64_type, start, true), global_context->builder.CreateNSWMul(lo_arg, llvm::ConstantInt::get(int64_type, step, true)));
+		auto end_value = global_context->builder.CreateNSWAdd(llvm::ConstantInt::get(int64_type, start, true), global_context->builder.CreateNSWMul(hi_arg, llvm::ConstantInt::get(int64_type, step, true)), "end");
+		global_context->builder.CreateStore(first_value, induction_inst);
+
+		auto cmp_basic_block = llvm::BasicBlock::Create(context, "cmp", function);
+		auto body_basic_block = llvm::BasicBlock::Create(context, "body", function);
+		auto after_basic_block = llvm::BasicBlock::Create(context, "after", function);
+		global_context->builder.CreateBr(cmp_basic_block);
+
+		global_context->builder.SetInsertPoint(cmp_basic_block);
+		auto end_cond = global_context->builder.CreateICmpSLT(global_context->builder.CreateLoad(induction_inst, var_name_), end_value, "loop_cond");
+		global_context->builder.CreateCondBr(end_cond, body_basic_block, after_basic_block);
+
+		global_context->builder.SetInsertPoint(body_basic_block);
+		auto current_value = global_context->builder.CreateLoad(induction_inst, var_name_);
+		global_context->builder.CreateStore(global_context->builder.CreateSIToFP(current_value, double_type), alloca_inst);
+		global_release_temporary(body_->codegen());
+
+		current_value = global_context->builder.CreateLoad(induction_inst, var_name_);
+		global_context->builder.CreateStore(global_context->builder.CreateNSWAdd(current_value, llvm::ConstantInt::get(int64_type, step, true), "next_var"), induction_inst);
+		global_context->builder.CreateBr(cmp_basic_block);
+
+		global_context->builder.SetInsertPoint(after_basic_block);
+		if (partial)
+		{
+			mark_reduction_(partial);
+			global_context->builder.CreateRet(global_context->builder.CreateLoad(partial));
+		}
+		else
+			global_context->builder.CreateRetVoid();
+
+		if (info)
+			info->end_function(global_context->builder);
+		llvm::verifyFunction(*function);
+		return function;
+	}
+
+	//iterations are independent, so the body is outlined and the runtime runs chunks of them on its thread pool
+	llvm::Value * for_expression_ast::codegen_parallel_()
+	{
+		auto & context = global_context->llvm_context;
+		auto int64_type = llvm::Type::getInt64Ty(context);
+		auto double_type = llvm::Type::getDoubleTy(context);
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
+
+		auto bound = get_counted_bound_();
+		if (!bound)
+			throw compile_error("\'parallel for\' needs an integral start and step and a condition \'" + var_name_ + " < bound\' or \'" + var_name_ + " <= bound\'", get_position());
+
+		std::pair<llvm::AllocaInst *, llvm::Type *> target;
+		if (!reduction_var_.empty())
+			target = get_reduction_target_();
+
+		//variables of the enclosing function are copied into the body, so they must stay unchanged
+		std::vector<std::pair<std::string, llvm::Type *>> captures;
+		std::vector<llvm::Type *> field_types;
+		std::vector<llvm::AllocaInst *> sources;
+		for (auto & named_value : global_context->named_values)
+		{
+			if (!named_value.second.first || named_value.first == var_name_ || named_value.first == reduction_var_)
+				continue;
+			if (body_->modifies(named_value.first))
+				throw compile_error("\'" + named_value.first + "\' of the enclosing function can not be changed or redeclared inside \'parallel for\'", get_position());
+
+			captures.push_back(std::make_pair(named_value.first, named_value.second.second));
+			field_types.push_back(named_value.second.second);
+			sources.push_back(named_value.second.first);
+		}
+
+		auto start_value = llvm::ConstantFP::get(double_type, static_cast<number_ast *>(start_.get())->get_value());
+		auto step_value = llvm::ConstantFP::get(double_type, static_cast<number_ast *>(step_.get())->get_value());
+		auto limit = bound->get_right()->codegen();
+		if (limit->getType() != double_type)
+			throw compile_error("Expected same type of operands", bound->get_position());
+		global_emit_location(this);
+
+		//number of iterations, counted from 0; it stays a number, since a bound such as 1/0 leaves it beyond any integer
+		//and the runtime reports that instead of converting it
+		auto span = global_context->builder.CreateFDiv(global_context->builder.CreateFSub(limit, start_value), step_value, "span");
+		llvm::Value * count;
+		auto module = parent->getParent();
+		if (bound->get_op_type() == operator_categories::LT)
+			count = global_context->builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::ceil, { double_type }), { span });
+		else
+			count = global_context->builder.CreateFAdd(global_context->builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::floor, { double_type }), { span }), llvm::ConstantFP::get(double_type, 1.0));
+		count = global_context->builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::maxnum, { double_type }), { count, llvm::ConstantFP::get(double_type, 0.0) }, "count");
+
+		auto env_type = llvm::StructType::get(context, field_types);
+		auto env = global_create_alloca(parent, "env", env_type);
+		for (unsigned i = 0; i != sources.size(); ++i)
+			global_context->builder.CreateStore(global_context->builder.CreateLoad(sources[i]), global_context->builder.CreateStructGEP(env_type, env, i));
+
+		auto saved_insert_point = global_context->builder.saveIP();
+		auto saved_named_values = global_context->named_values;
+		auto saved_induction_values = global_context->induction_values;
+		auto saved_safe_indices = global_context->safe_indices;
+		auto saved_argument_slots = global_context->argument_slots;
+		auto saved_tail_recursion_block = global_context->tail_recursion_block;
+		auto saved_string_slots = global_context->string_slots;
+		auto saved_in_parallel_body = global_context->in_parallel_body;
+
+		global_context->named_values.clear();
+		global_context->induction_values.clear();
+		global_context->safe_indices.clear();
+		global_context->argument_slots.clear();
+		global_context->tail_recursion_block = nullptr;
+		global_context->string_slots.clear();
+		global_context->in_parallel_body = true;
+
+		auto body_function = codegen_parallel_body_(bound, env_type, captures);
+
+		global_context->named_values = saved_named_values;
+		global_context->induction_values = saved_induction_values;
+		global_context->safe_indices = saved_safe_indices;
+		global_context->argument_slots = saved_argument_slots;
+		global_context->tail_recursion_block = saved_tail_recursion_block;
+		global_context->string_slots = saved_string_slots;
+		global_context->in_parallel_body = saved_in_parallel_body;
+		global_context->builder.restoreIP(saved_insert_point);
+		global_emit_location(this);
+
+		auto int8_ptr_type = llvm::Type::getInt8PtrTy(context);
+		if (!target.first)
+		{
+			llvm::Value * args[] = { global_context->builder.CreateBitCast(body_function, int8_ptr_type), global_context->builder.CreateBitCast(env, int8_ptr_type), count };
+			global_context->builder.CreateCall(global_context->JIT_helper->get_function("parallel_for"), args);
+		}
+		else
+		{
+			//the runtime combines the partial results of the chunks
+			auto op_value = llvm::ConstantInt::get(int64_type, static_cast<std::int64_t>(reduction_op_));
+			llvm::Value * args[] = { global_context->builder.CreateBitCast(body_function, int8_ptr_type), op_value, global_context->builder.CreateBitCast(env, int8_ptr_type), count };
+			auto result = global_context->builder.CreateCall(global_context->JIT_helper->get_function("parallel_reduce"), args);
+			global_context->builder.CreateStore(codegen_combine_(global_context->builder.CreateLoad(target.first), result), target.first);
+		}
+
+		return llvm::Constant::getNullValue(double_type);
 	}
 
 	llvm::Value * unary_expression_ast::codegen()
 	{
-		auto function = global_JIT_helper->get_function("unary" + op_name_);
+		global_emit_location(this);
+		auto function = global_context->JIT_helper->get_function("unary" + op_name_);
 		if (!function)
 			throw compile_error("Unknown unary operator", get_position());
 
@@ -917,14 +2489,18 @@ namespace summer_lang
 			return nullptr;
 		
 		llvm::Value * args[] = { operand };
-		return global_builder.CreateCall(function, args, "unaryop");
+		auto result = global_context->builder.CreateCall(function, args, "unaryop");
+		global_release_temporary(operand);
+		return result;
 	}
 
 	llvm::Value * var_ast::codegen()
 	{
+		global_emit_location(this);
 		std::vector<std::pair<llvm::AllocaInst *, llvm::Type *>> old_bindings;
+		auto first_slot = global_context->string_slots.size();
 
-		auto parent = global_builder.GetInsertBlock()->getParent();
+		auto parent = global_context->builder.GetInsertBlock()->getParent();
 		for (auto i = vars_.begin(); i != vars_.end(); ++i)
 		{
 			auto var_name = std::get<0>(*i);
@@ -934,19 +2510,31 @@ namespace summer_lang
 			auto init_value = var_init->codegen();
 
 			auto alloca_inst = global_create_alloca(parent, var_name, var_type);
-			global_builder.CreateStore(init_value, alloca_inst);
+			if (global_is_string(init_value))
+			{
+				global_context->builder.CreateStore(global_is_owned(init_value) ? init_value : global_retain(init_value), alloca_inst);
+				global_context->string_slots.push_back(alloca_inst);
+			}
+			else
+				global_context->builder.CreateStore(init_value, alloca_inst);
 
-			old_bindings.push_back(global_named_values[var_name]);
-			global_named_values[var_name].first = alloca_inst;
-			global_named_values[var_name].second = var_type;
+			old_bindings.push_back(global_context->named_values[var_name]);
+			global_context->named_values[var_name].first = alloca_inst;
+			global_context->named_values[var_name].second = var_type;
 		}
 
 		auto body_value = body_->codegen();
 		if (!body_value)
 			return nullptr;
 
+		//the value of the body may be one of the variables released below
+		if (global_is_string(body_value) && !global_is_owned(body_value))
+			body_value = global_retain(body_value);
+		global_release_slots(first_slot);
+		global_context->string_slots.resize(first_slot);
+
 		for (auto i = 0; i != vars_.size(); ++i)
-			global_named_values[std::get<0>(vars_[i])] = old_bindings[i];
+			global_context->named_values[std::get<0>(vars_[i])] = old_bindings[i];
 
 		return body_value;
 	}
@@ -954,17 +2542,220 @@ namespace summer_lang
 	llvm::Value * block_ast::codegen()
 	{
 		for (auto & expr : exprs_)
-			expr->codegen();
+			global_release_temporary(expr->codegen());
 
-		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(llvm::getGlobalContext()));
+		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(global_context->llvm_context));
+	}
+
+	static bool passes_frame_address(llvm::CallInst * call)
+	{
+		for (auto & arg : call->arg_operands())
+		{
+			auto value = arg->stripPointerCasts();
+			while (auto gep = llvm::dyn_cast<llvm::GetElementPtrInst>(value))
+				value = gep->getPointerOperand()->stripPointerCasts();
+			if (llvm::isa<llvm::AllocaInst>(value))
+				return true;
+		}
+		return false;
 	}
 
 	llvm::Value * return_ast::codegen()
 	{
-		return global_builder.CreateRet(ret_->codegen());
+		global_emit_location(this);
+		if (global_context->in_parallel_body)
+			throw compile_error("\'return\' is not allowed inside \'parallel for\'", get_position());
+		auto function = global_context->builder.GetInsertBlock()->getParent();
+		auto return_type = function->getReturnType();
+
+		auto call = dynamic_cast<call_expression_ast *>(ret_.get());
+		if (call && global_context->tail_recursion_block && call->get_callee() == function->getName() && call->get_args().size() == global_context->argument_slots.size())
+		{
+			//every argument is evaluated before any parameter is overwritten
+			std::vector<llvm::Value *> args_value;
+			for (auto & arg : call->get_args())
+				args_value.push_back(arg->codegen());
+			global_emit_location(this);
+
+			//an argument may borrow the old value of another parameter, so every string is retained
+			//before any slot is overwritten, and the old values are only released after all stores
+			std::vector<llvm::Value *> old_values;
+			for (std::size_t i = 0; i != args_value.size(); ++i)
+			{
+				if (args_value[i]->getType() != global_context->argument_slots[i]->getAllocatedType())
+					throw compile_error("Incorrect type of argument passed", get_position());
+				if (global_is_string(args_value[i]) && !global_is_owned(args_value[i]))
+					args_value[i] = global_retain(args_value[i]);
+			}
+			for (std::size_t i = 0; i != args_value.size(); ++i)
+				if (global_is_string(args_value[i]))
+					old_values.push_back(global_context->builder.CreateLoad(global_context->argument_slots[i]));
+			for (std::size_t i = 0; i != args_value.size(); ++i)
+				global_context->builder.CreateStore(args_value[i], global_context->argument_slots[i]);
+			for (auto old_value : old_values)
+				global_release(old_value);
+
+			//parameters stay alive across the jump, only the locals of the body are released
+			for (auto slot : global_context->string_slots)
+				if (std::find(global_context->argument_slots.begin(), global_context->argument_slots.end(), slot) == global_context->argument_slots.end())
+					global_release(global_context->builder.CreateLoad(slot));
+			global_context->builder.CreateBr(global_context->tail_recursion_block);
+		}
+		else
+		{
+			auto ret_value = ret_->codegen();
+			global_emit_location(this);
+			if (!return_type->isVoidTy() && ret_value->getType() != return_type)
+				throw compile_error("Returned value does not match the return type", get_position());
+
+			//the callee may reuse this frame unless it is handed a pointer into it, as 'spawn' and 'bench' are
+			if (auto call_inst = llvm::dyn_cast<llvm::CallInst>(ret_value))
+				if (!passes_frame_address(call_inst))
+					call_inst->setTailCall();
+
+			//the caller receives an owned reference
+			if (return_type->isVoidTy())
+				global_release_temporary(ret_value);
+			else if (global_is_string(ret_value) && !global_is_owned(ret_value))
+				ret_value = global_retain(ret_value);
+			global_release_slots(0);
+
+			if (return_type->isVoidTy())
+				global_context->builder.CreateRetVoid();
+			else
+				global_context->builder.CreateRet(ret_value);
+		}
+
+		//anything after 'return' is dead, it goes into a block of its own that simplifycfg removes
+		global_context->builder.SetInsertPoint(llvm::BasicBlock::Create(global_context->llvm_context, "after_return", function));
+		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(global_context->llvm_context));
 	}
 	llvm::Value * empty_ast::codegen()
 	{
-		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(llvm::getGlobalContext()));
+		return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(global_context->llvm_context));
+	}
+
+	llvm::Value * index_ast::codegen_address_()
+	{
+		global_emit_location(this);
+		auto & context = global_context->llvm_context;
+		auto int64_type = llvm::Type::getInt64Ty(context);
+
+		auto array = array_->codegen();
+		if (array->getType() != global_array_type())
+			throw compile_error("Only arrays can be indexed", get_position());
+
+		llvm::Value * index = nullptr;
+		auto index_variable = dynamic_cast<variable_ast *>(index_.get());
+		if (index_variable)
+		{
+			auto induction = global_context->induction_values.find(index_variable->get_name());
+			if (induction != global_context->induction_values.end())
+				index = global_context->builder.CreateLoad(induction->second, index_variable->get_name());
+		}
+		if (!index)
+		{
+			auto index_value = index_->codegen();
+			if (!index_value->getType()->isDoubleTy())
+				throw compile_error("Index must be a number", get_position());
+			index = global_context->builder.CreateFPToSI(index_value, int64_type, "index");
+		}
+
+		auto array_variable = dynamic_cast<variable_ast *>(array_.get());
+		auto is_safe = index_variable && array_variable
+			&& global_context->safe_indices.count(std::make_pair(index_variable->get_name(), array_variable->get_name()));
+		if (!is_safe)
+		{
+			//a negative index wraps around to a huge unsigned one, so a single compare checks both ends
+			auto length = global_array_length(array);
+			auto parent = global_context->builder.GetInsertBlock()->getParent();
+			auto fail_basic_block = llvm::BasicBlock::Create(context, "out_of_bounds", parent);
+			auto ok_basic_block = llvm::BasicBlock::Create(context, "in_bounds", parent);
+
+			auto in_bounds = global_context->builder.CreateICmpULT(index, length, "in_bounds");
+			global_context->builder.CreateCondBr(in_bounds, ok_basic_block, fail_basic_block, llvm::MDBuilder(context).createBranchWeights(1 << 20, 1));
+
+			global_context->builder.SetInsertPoint(fail_basic_block);
+			llvm::Value * args[] = { index, length };
+			global_context->builder.CreateCall(global_context->JIT_helper->get_function("array_out_of_bounds"), args);
+			global_context->builder.CreateUnreachable();
+
+			global_context->builder.SetInsertPoint(ok_basic_block);
+		}
+
+		return global_context->builder.CreateInBoundsGEP(global_array_data(array), index, "element_ptr");
+	}
+
+	llvm::Value * index_ast::codegen()
+	{
+		return global_context->builder.CreateLoad(codegen_address_(), "element");
+	}
+
+	llvm::Value * index_ast::codegen_store(llvm::Value * value)
+	{
+		if (!value->getType()->isDoubleTy())
+			throw compile_error("Only numbers can be stored in an array", get_position());
+		global_context->builder.CreateStore(value, codegen_address_());
+		return value;
+	}
+
+	bool var_ast::modifies(const std::string & name) const
+	{
+		for (auto & var : vars_)
+			if (std::get<0>(var) == name || std::get<2>(var)->modifies(name))
+				return true;
+		return body_->modifies(name);
+	}
+
+	bool binary_expression_ast::modifies(const std::string & name) const
+	{
+		if (op_type_ == operator_categories::ASSIGN)
+		{
+			auto variable = dynamic_cast<variable_ast *>(left_.get());
+			if (variable && variable->get_name() == name)
+				return true;
+		}
+		return left_->modifies(name) || right_->modifies(name);
+	}
+
+	bool call_expression_ast::modifies(const std::string & name) const
+	{
+		for (auto & arg : args_)
+			if (arg->modifies(name))
+				return true;
+		return false;
+	}
+
+	bool block_ast::modifies(const std::string & name) const
+	{
+		for (auto & expr : exprs_)
+			if (expr->modifies(name))
+				return true;
+		return false;
+	}
+
+	bool return_ast::modifies(const std::string & name) const
+	{
+		return ret_ && ret_->modifies(name);
+	}
+
+	bool for_expression_ast::modifies(const std::string & name) const
+	{
+		return var_name_ == name || reduction_var_ == name || start_->modifies(name) || end_->modifies(name) || step_->modifies(name) || body_->modifies(name);
+	}
+
+	bool if_expression_ast::modifies(const std::string & name) const
+	{
+		return cond_->modifies(name) || then_part_->modifies(name) || else_part_->modifies(name);
+	}
+
+	bool unary_expression_ast::modifies(const std::string & name) const
+	{
+		return expr_->modifies(name);
+	}
+
+	bool index_ast::modifies(const std::string & name) const
+	{
+		return array_->modifies(name) || index_->modifies(name);
 	}
 }
\ No newline at end of file
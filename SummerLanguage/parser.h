@@ -10,25 +10,35 @@
 #include <llvm\IR\LegacyPassManager.h>
 #include <llvm\Analysis\Passes.h>
 #include <llvm\IR\Instruction.h>
+#include <llvm\IR\MDBuilder.h>
+#include <llvm\IR\Intrinsics.h>
 
 #include <string>
 #include <vector>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <set>
+#include <algorithm>
 #include <memory>
 #include <utility>
+#include <atomic>
 
 #include "tokenizer.h"
 #include "MCJIT_helper.h"
 #include "error.h"
 #include "lib.h"
+#include "statistics.h"
+#include "thread_pool.h"
 
 namespace summer_lang
 {
 	class ast
 	{
 		int start_row_no_;
+
+		static std::atomic<std::size_t> created_count_;		//source files are parsed on several threads
 	public:
 		ast(const ast &) = delete;
 		ast & operator=(const ast &) = delete;
@@ -36,6 +46,7 @@ namespace summer_lang
 		ast(int start_row_no)
 			: start_row_no_(start_row_no)
 		{
+			created_count_++;
 		}
 
 		virtual ~ast()
@@ -44,10 +55,24 @@ namespace summer_lang
 
 		virtual llvm::Value * codegen() = 0;
 
+		//generates the value as an i1 for branches, without converting it to a number first
+		virtual llvm::Value * codegen_condition();
+
+		//whether evaluating this node may assign to, or shadow, the variable 'name'
+		virtual bool modifies(const std::string & name) const
+		{
+			return false;
+		}
+
 		int get_position() const
 		{
 			return start_row_no_;
 		}
+
+		static std::size_t get_created_count()
+		{
+			return created_count_;
+		}
 	};
 
 	class number_ast
@@ -61,6 +86,11 @@ namespace summer_lang
 		{
 		}
 
+		double get_value() const
+		{
+			return value_;
+		}
+
 		virtual llvm::Value * codegen() override;
 	};
 
@@ -111,6 +141,7 @@ namespace summer_lang
 		}
 
 		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class binary_expression_ast
@@ -119,6 +150,10 @@ namespace summer_lang
 		std::string op_name_;
 		operator_categories op_type_;
 		std::unique_ptr<ast> left_, right_;
+
+		bool is_comparison_() const;
+		llvm::Value * codegen_comparison_(llvm::Value * l_value, llvm::Value * r_value);
+		llvm::Value * codegen_append_(const variable_ast * variable);
 	public:
 		binary_expression_ast(std::string op_name, operator_categories op_type, std::unique_ptr<ast> left, std::unique_ptr<ast> right, int start_row_no)
 			: ast(start_row_no)
@@ -129,7 +164,24 @@ namespace summer_lang
 		{
 		}
 
+		operator_categories get_op_type() const
+		{
+			return op_type_;
+		}
+
+		ast * get_left() const
+		{
+			return left_.get();
+		}
+
+		ast * get_right() const
+		{
+			return right_.get();
+		}
+
 		virtual llvm::Value * codegen()	override;
+		virtual llvm::Value * codegen_condition() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class call_expression_ast
@@ -145,7 +197,68 @@ namespace summer_lang
 		{
 		}
 
+		std::string get_callee() const
+		{
+			return callee_;
+		}
+
+		const decltype(args_) & get_args() const
+		{
+			return args_;
+		}
+
+		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
+	};
+
+	//a call the runtime makes later, or repeatedly, through a thunk: the arguments are evaluated once
+	//and packed into an 'env' struct, which the thunk unpacks before calling
+	class deferred_call_ast
+		: public ast
+	{
+	protected:
+		std::unique_ptr<call_expression_ast> call_;
+
+		llvm::Function * get_callee_() const;
+		llvm::AllocaInst * codegen_env_(llvm::Function * callee, bool retain_strings, std::vector<llvm::Value *> & args_value);
+		llvm::Function * codegen_thunk_(llvm::Function * callee, llvm::StructType * env_type, bool release_strings);
+	public:
+		deferred_call_ast(std::unique_ptr<call_expression_ast> call, int start_row_no)
+			: ast(start_row_no)
+			, call_(std::move(call))
+		{
+		}
+
+		virtual bool modifies(const std::string & name) const override;
+	};
+
+	//'spawn f(args)' starts the call on the thread pool and evaluates to a future, 'await(h)' returns its result
+	class spawn_ast
+		: public deferred_call_ast
+	{
+	public:
+		spawn_ast(std::unique_ptr<call_expression_ast> call, int start_row_no)
+			: deferred_call_ast(std::move(call), start_row_no)
+		{
+		}
+
+		virtual llvm::Value * codegen() override;
+	};
+
+	//'bench f(args)' or 'bench count f(args)' times the call, prints the statistics and evaluates to the mean ns/op
+	class bench_ast
+		: public deferred_call_ast
+	{
+		std::unique_ptr<ast> iterations_;		//null lets the runtime pick the count
+	public:
+		bench_ast(std::unique_ptr<ast> iterations, std::unique_ptr<call_expression_ast> call, int start_row_no)
+			: deferred_call_ast(std::move(call), start_row_no)
+			, iterations_(std::move(iterations))
+		{
+		}
+
 		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class empty_ast :
@@ -172,6 +285,7 @@ namespace summer_lang
 		}
 
 		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class return_ast
@@ -186,6 +300,7 @@ namespace summer_lang
 		}
 
 		virtual llvm::Value	* codegen() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class for_expression_ast
@@ -194,9 +309,22 @@ namespace summer_lang
 		std::string var_name_;
 		llvm::Type * var_type_;
 		std::unique_ptr<ast> start_, end_, step_, body_;
-
+		bool parallel_;
+		reduction_categories reduction_op_;
+		std::string reduction_var_;		//the variable of 'reduce(op: var)', empty without the clause
+
+		binary_expression_ast * get_counted_bound_() const;
+		llvm::Value * codegen_serial_();
+		llvm::Value * codegen_counted_(binary_expression_ast * bound, llvm::AllocaInst * alloca_inst, std::pair<llvm::AllocaInst *, llvm::Type *> old_val);
+		llvm::Value * codegen_parallel_();
+		llvm::Function * codegen_parallel_body_(binary_expression_ast * bound, llvm::StructType * env_type, const std::vector<std::pair<std::string, llvm::Type *>> & captures);
+		std::pair<llvm::AllocaInst *, llvm::Type *> get_reduction_target_() const;
+		llvm::AllocaInst * codegen_partial_(llvm::Function * function);
+		void mark_reduction_(llvm::AllocaInst * partial) const;
+		void relax_min_max_(llvm::AllocaInst * partial, llvm::StoreInst * store) const;
+		llvm::Value * codegen_combine_(llvm::Value * left, llvm::Value * right) const;
 	public:
-		for_expression_ast(const std::string & var_name, llvm::Type * var_type, std::unique_ptr<ast> start, std::unique_ptr<ast> end, std::unique_ptr<ast> step, std::unique_ptr<ast> body, int start_row_no)
+		for_expression_ast(const std::string & var_name, llvm::Type * var_type, std::unique_ptr<ast> start, std::unique_ptr<ast> end, std::unique_ptr<ast> step, std::unique_ptr<ast> body, bool parallel, reduction_categories reduction_op, const std::string & reduction_var, int start_row_no)
 			: ast(start_row_no)
 			, var_name_(var_name)
 			, var_type_(var_type)
@@ -204,10 +332,14 @@ namespace summer_lang
 			, end_(std::move(end))
 			, step_(std::move(step))
 			, body_(std::move(body))
+			, parallel_(parallel)
+			, reduction_op_(reduction_op)
+			, reduction_var_(reduction_var)
 		{
 		}
 
 		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class if_expression_ast
@@ -224,6 +356,7 @@ namespace summer_lang
 		}
 
 		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
 	};
 
 	class unary_expression_ast
@@ -240,6 +373,26 @@ namespace summer_lang
 		}
 
 		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
+	};
+
+	class index_ast
+		: public ast
+	{
+		std::unique_ptr<ast> array_, index_;
+
+		llvm::Value * codegen_address_();
+	public:
+		index_ast(std::unique_ptr<ast> array, std::unique_ptr<ast> index, int start_row_no)
+			: ast(start_row_no)
+			, array_(std::move(array))
+			, index_(std::move(index))
+		{
+		}
+
+		virtual llvm::Value * codegen() override;
+		virtual bool modifies(const std::string & name) const override;
+		llvm::Value * codegen_store(llvm::Value * value);
 	};
 
 	class prototype_ast
@@ -250,6 +403,7 @@ namespace summer_lang
 
 		bool is_operator_;
 		int precedence_;
+		bool fast_math_;
 
 		int start_row_no_;
 	public:
@@ -259,6 +413,7 @@ namespace summer_lang
 			, ret_type_(ret_type)
 			, is_operator_(is_operator)
 			, precedence_(precedence)
+			, fast_math_(false)
 			, start_row_no_(start_row_no)
 		{
 		}
@@ -291,6 +446,16 @@ namespace summer_lang
 			return precedence_;
 		}
 
+		void set_fast_math()
+		{
+			fast_math_ = true;
+		}
+
+		bool is_fast_math() const
+		{
+			return fast_math_;
+		}
+
 		int get_position() const
 		{
 			return start_row_no_;
@@ -301,39 +466,175 @@ namespace summer_lang
 	{
 		std::unique_ptr<prototype_ast> prototype_;
 		std::unique_ptr<ast> body_;
+		bool echo_;
 
 		int start_row_no_;
+
+		llvm::Function * codegen_body_(llvm::Function * function);
 	public:
 		function_ast(std::unique_ptr<prototype_ast> prototype, std::unique_ptr<ast> body, int start_row_no)
 			: prototype_(std::move(prototype))
 			, body_(std::move(body))
+			, echo_(false)
 			, start_row_no_(start_row_no)
 		{
 		}
 
 		llvm::Function * codegen();
 
+		//a top-level expression prints its number or string value, for the REPL
+		void set_echo()
+		{
+			echo_ = true;
+		}
+
+		const std::string get_name() const
+		{
+			return prototype_->get_name();
+		}
+
 		int get_position() const
 		{
 			return start_row_no_;
 		}
 	};
 
-	static llvm::IRBuilder<> global_builder(llvm::getGlobalContext());
-	static std::map<std::string, std::pair<llvm::AllocaInst *, llvm::Type *>> global_named_values;
-	static std::unique_ptr<MCJIT_helper> global_JIT_helper;
-	static std::map<std::string, int> global_op_precedence;
+	//Everything a compilation shares between the nodes it generates. Each parser owns one, with its own LLVM context
+	//and JIT session, so parsers on different threads compile independently. The nodes reach it through
+	//global_context, which a parser points at its own context while it works.
+	struct compile_context
+	{
+		llvm::LLVMContext llvm_context;		//first, so that it outlives everything created in it
+		llvm::IRBuilder<> builder;
+		std::map<std::string, std::pair<llvm::AllocaInst *, llvm::Type *>> named_values;
+		std::unique_ptr<MCJIT_helper> JIT_helper;
+		std::map<std::string, int> op_precedence;
+		std::map<std::string, llvm::AllocaInst *> induction_values;		//integer shadows of counted 'for' variables
+		std::set<std::pair<std::string, std::string>> safe_indices;		//(induction variable, array) pairs known to be in bounds
+		std::vector<llvm::AllocaInst *> argument_slots;		//parameters of the function being generated, in order
+		llvm::BasicBlock * tail_recursion_block;
+		std::vector<llvm::AllocaInst *> string_slots;		//string variables in scope, released when they go out of scope
+		bool in_parallel_body;
+		llvm::StructType * array_type;
+		llvm::StructType * future_type;
+
+		compile_context(const compile_context &) = delete;
+		compile_context & operator=(const compile_context &) = delete;
+
+		compile_context()
+			: builder(llvm_context)
+			, tail_recursion_block(nullptr)
+			, in_parallel_body(false)
+			, array_type(nullptr)
+			, future_type(nullptr)
+		{
+		}
+	};
+
+	extern thread_local compile_context * global_context;
+
+	//points global_context at a parser's context until the end of the scope
+	class context_scope
+	{
+		compile_context * previous_;
+	public:
+		context_scope(const context_scope &) = delete;
+		context_scope & operator=(const context_scope &) = delete;
+
+		context_scope(compile_context * context)
+			: previous_(global_context)
+		{
+			global_context = context;
+		}
+
+		~context_scope()
+		{
+			global_context = previous_;
+		}
+	};
 
-	static int get_op_precedence(const std::string & op_name);
-	static void set_op_precedence(const std::string & op_name, int precedence);
-	static llvm::AllocaInst * global_create_alloca(llvm::Function * function, const std::string & name, llvm::Type * type);
+	int get_op_precedence(const std::string & op_name);
+	void set_op_precedence(const std::string & op_name, int precedence);
+	llvm::AllocaInst * global_create_alloca(llvm::Function * function, const std::string & name, llvm::Type * type);
+	void global_emit_location(const ast * node);
+	bool global_is_string(llvm::Value * value);
+	bool global_is_owned(llvm::Value * value);
+	llvm::Value * global_retain(llvm::Value * value);
+	void global_release(llvm::Value * value);
+	void global_release_temporary(llvm::Value * value);
+	void global_store_string(llvm::Value * value, llvm::AllocaInst * slot);
+	void global_release_slots(std::size_t first);
+	llvm::PointerType * global_array_type();
+	llvm::PointerType * global_future_type();
+	llvm::Value * global_array_data(llvm::Value * array);
+	llvm::Value * global_array_length(llvm::Value * array);
+	const variable_ast * global_length_query(const ast * node);
 
 	class parser
 	{
+		//a top-level item of an imported source file, parsed before anything in the file is compiled
+		enum class item_categories
+		{
+			EXTERN,
+			FUNCTION,
+			EXPRESSION,
+			IMPORT
+		};
+
+		struct source_item
+		{
+			item_categories type;
+			std::unique_ptr<prototype_ast> prototype;		//EXTERN
+			std::unique_ptr<function_ast> function;		//FUNCTION and EXPRESSION
+			std::string path;		//IMPORT, already resolved against the importing file
+			int row_no;
+		};
+
+		//a source file is parsed once per session, its items run when the first importer reaches it
+		struct source_unit
+		{
+			std::string path;
+			std::vector<source_item> items;
+			std::string error;		//a parse error ends the items, it is reported once the items before it have run
+			bool compiled;
+		};
+
+		struct unit_task
+		{
+			compile_context * context;
+			std::string path;
+			std::unique_ptr<source_unit> unit;
+		};
+
+		struct parse_only
+		{
+		};
+
+		std::unique_ptr<compile_context> context_;		//null in the parsers that only parse
 		std::unique_ptr<token> current_token_;
 		std::unique_ptr<tokenizer> p_tokenizer_;
+		std::string directory_;		//of the file being parsed, imports are relative to it
+		std::map<std::string, int> op_precedence_;		//operators defined in the source parsed so far
+		std::map<std::string, std::unique_ptr<source_unit>> units_;
+
+		compile_statistics * statistics_;
+		bool debug_info_;
+		bool echo_;
+		double lex_seconds_;
+		std::size_t token_count_;
+		double record_lex_seconds_;
+		std::size_t record_token_count_;
+		std::size_t record_ast_count_;
+
+		//a parser that only builds syntax trees, for parsing source files on the thread pool
+		explicit parser(parse_only);
 
 		void get_next_token_();
+		int get_op_precedence_(const std::string & op) const;
+
+		function_statistics * begin_record_();
+		void end_parse_record_(function_statistics * record, const std::string & name);
+		void codegen_record_(function_statistics * record, llvm::Function * function);
 
 		std::unique_ptr<ast> parse_number_();
 		std::unique_ptr<ast> parse_string_();
@@ -343,12 +644,15 @@ namespace summer_lang
 		std::unique_ptr<ast> parse_expression_();
 		std::unique_ptr<ast> parse_bin_op_right_(int expr_precedence, std::unique_ptr<ast> left, int start_row);
 		std::unique_ptr<ast> parse_if_();
-		std::unique_ptr<ast> parse_for_();
+		std::unique_ptr<ast> parse_for_(bool parallel);
 		std::unique_ptr<ast> parse_unary_();
 		std::unique_ptr<ast> parse_var_();
 		std::unique_ptr<ast> parse_block_();
 		std::unique_ptr<ast> parse_return_();
+		std::unique_ptr<ast> parse_spawn_();
+		std::unique_ptr<ast> parse_bench_();
 		std::unique_ptr<ast> parse_empty_();
+		llvm::Type * parse_array_suffix_(llvm::Type * element_type);
 
 		std::unique_ptr<prototype_ast> parse_prototype_();
 		std::unique_ptr<function_ast> parse_function_();
@@ -356,13 +660,39 @@ namespace summer_lang
 		std::unique_ptr<function_ast> parse_top_level_expr_();
 
 		void handle_extern();
+		void handle_import();
 		void handle_function();
 		void handle_top_level_expr();
+
+		void define_extern_(std::unique_ptr<prototype_ast> proto_ast, function_statistics * record);
+		void define_function_(std::unique_ptr<function_ast> func_ast, function_statistics * record);
+		void run_top_level_expr_(std::unique_ptr<function_ast> func_ast, function_statistics * record);
+
+		std::unique_ptr<source_unit> parse_unit_(const std::string & path);
+		static double parse_unit_task_(void * env);
+		void load_units_(const std::vector<std::string> & paths);
+		void compile_unit_(source_unit & unit);
+		void import_source_(const std::string & path);
 	public:
 		parser(const parser &) = delete;
 		parser & operator=(const parser &) = delete;
 
 		parser();
 		void parse(const std::string & file_name);
+		void parse(std::istream & source_code);
+		//the files and their imports are parsed in parallel, then compiled in order into one session
+		void parse(const std::vector<std::string> & file_names);
+		void set_statistics(compile_statistics * statistics);
+		void enable_jit_symbols();
+		void enable_debug_info();
+		void enable_fast_math();
+		void enable_echo();
+		//see MCJIT_helper::enable_quick_anonymous
+		void enable_quick_expressions();
+		void load_library(const std::string & path);
+		//a function defined by an earlier 'parse', null when there is none
+		llvm::Function * find_function(const std::string & name) const;
+		//compiles the function first when it is still in the open module
+		void * get_function_address(llvm::Function * function);
 	};
 }
@@ -0,0 +1,142 @@
+#include "region_allocator.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace summer_lang
+{
+	region_allocator::region_allocator(std::size_t chunk_size)
+		: current_(0)
+		, top_(nullptr)
+		, end_(nullptr)
+		, depth_(0)
+		, chunk_size_(chunk_size)
+	{
+		std::fill(std::begin(free_lists_), std::end(free_lists_), nullptr);
+	}
+
+	region_allocator::~region_allocator()
+	{
+		for (auto & c : chunks_)
+			std::free(c.data);
+	}
+
+	void region_allocator::enter()
+	{
+		if (depth_++)
+			return;
+
+		current_ = 0;
+		std::fill(std::begin(free_lists_), std::end(free_lists_), nullptr);
+		top_ = chunks_.empty() ? nullptr : chunks_[0].data;
+		end_ = chunks_.empty() ? nullptr : chunks_[0].data + chunks_[0].size;
+	}
+
+	void region_allocator::leave()
+	{
+		if (!depth_ || --depth_)
+			return;
+
+		//the first chunk is kept for the next expression, the rest were only needed by a large one
+		for (std::size_t i = 1; i < chunks_.size(); ++i)
+			std::free(chunks_[i].data);
+		if (chunks_.size() > 1)
+			chunks_.resize(1);
+		std::fill(std::begin(free_lists_), std::end(free_lists_), nullptr);
+		top_ = end_ = nullptr;
+	}
+
+	bool region_allocator::next_chunk_(std::size_t size, std::size_t alignment)
+	{
+		for (++current_; current_ < chunks_.size(); ++current_)
+		{
+			if (chunks_[current_].size >= size + alignment)
+			{
+				top_ = chunks_[current_].data;
+				end_ = top_ + chunks_[current_].size;
+				return true;
+			}
+		}
+
+		chunk c{ nullptr, std::max(chunk_size_, size + alignment) };
+		c.data = static_cast<char *>(std::malloc(c.size));
+		if (!c.data)
+			return false;
+
+		chunks_.push_back(c);
+		current_ = chunks_.size() - 1;
+		top_ = c.data;
+		end_ = c.data + c.size;
+		return true;
+	}
+
+	std::size_t region_allocator::size_class_(std::size_t size)
+	{
+		std::size_t index = 0;
+		for (auto class_size = min_class_size; class_size < size && index != class_count; class_size <<= 1)
+			++index;
+		return index;
+	}
+
+	//only the chunks in use since enter() hold live blocks
+	bool region_allocator::owns_(const void * address) const
+	{
+		auto p = static_cast<const char *>(address);
+		for (std::size_t i = 0; i <= current_ && i < chunks_.size(); ++i)
+			if (p >= chunks_[i].data && p < chunks_[i].data + chunks_[i].size)
+				return true;
+		return false;
+	}
+
+	void * region_allocator::allocate(std::size_t size, std::size_t alignment)
+	{
+		auto index = size_class_(size);
+		if (index == class_count)
+			return bump_(size, alignment);
+
+		//every small block spans its whole class, so any of them can go to the free list later
+		if (alignment > min_class_size)
+			return bump_(min_class_size << index, alignment);
+		if (auto block = free_lists_[index])
+		{
+			free_lists_[index] = *static_cast<void **>(block);
+			return block;
+		}
+		return bump_(min_class_size << index, min_class_size);
+	}
+
+	void * region_allocator::bump_(std::size_t size, std::size_t alignment)
+	{
+		auto start = top_ ? (reinterpret_cast<std::uintptr_t>(top_) + alignment - 1) & ~(std::uintptr_t(alignment) - 1) : 0;
+		if (!top_ || start + size > reinterpret_cast<std::uintptr_t>(end_))
+		{
+			if (!next_chunk_(size, alignment))
+				return nullptr;
+			start = (reinterpret_cast<std::uintptr_t>(top_) + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+		}
+
+		top_ = reinterpret_cast<char *>(start + size);
+		return reinterpret_cast<void *>(start);
+	}
+
+	void region_allocator::deallocate(void * address, std::size_t size)
+	{
+		if (!depth_ || !address || !owns_(address))
+			return;
+
+		auto index = size_class_(size);
+		if (index != class_count)
+		{
+			*static_cast<void **>(address) = free_lists_[index];
+			free_lists_[index] = address;
+		}
+		else if (static_cast<char *>(address) + size == top_)
+			top_ = static_cast<char *>(address);
+	}
+
+	region_allocator & region_allocator::get_current()
+	{
+		thread_local region_allocator region;
+		return region;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace summer_lang
+{
+	//Bump allocator for the runtime objects created while one top-level expression runs.
+	//Everything allocated after enter() is released at once by the matching leave().
+	//Small allocations are rounded up to a power of two, and a single object given back is kept in the
+	//free list of its size class, so a loop that keeps replacing a string reuses the same few blocks.
+	class region_allocator
+	{
+		struct chunk
+		{
+			char * data;
+			std::size_t size;
+		};
+
+		static const std::size_t min_class_size = 16;
+		static const std::size_t class_count = 16;		//16 bytes to 512 KB, larger blocks are only reclaimed by leave()
+
+		std::vector<chunk> chunks_;
+		void * free_lists_[class_count];
+		std::size_t current_;		//index of the chunk the bump pointer is in
+		char * top_;
+		char * end_;
+		std::size_t depth_;
+		std::size_t chunk_size_;
+
+		bool next_chunk_(std::size_t size, std::size_t alignment);
+		void * bump_(std::size_t size, std::size_t alignment);
+		bool owns_(const void * address) const;
+		static std::size_t size_class_(std::size_t size);
+	public:
+		region_allocator(const region_allocator &) = delete;
+		region_allocator & operator=(const region_allocator &) = delete;
+
+		region_allocator(std::size_t chunk_size = 1 << 20);
+		~region_allocator();
+
+		void enter();
+		void leave();
+
+		bool is_active() const
+		{
+			return depth_ != 0;
+		}
+
+		//null when the memory is exhausted
+		void * allocate(std::size_t size, std::size_t alignment = 16);
+		//'size' is the one passed to allocate, blocks of another thread's region are ignored
+		void deallocate(void * address, std::size_t size);
+
+		//the region of the calling thread
+		static region_allocator & get_current();
+	};
+}
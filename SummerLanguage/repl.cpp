@@ -0,0 +1,123 @@
+#include "repl.h"
+#include "parser.h"
+#include "benchmark.h"
+#include <sstream>
+#include <cstdio>
+
+namespace summer_lang
+{
+	//a piece is complete when its blocks and brackets are closed and its last token can end a definition or an expression,
+	//so 'function f(x: number)->number' waits for the 'begin' on the next line
+	bool repl::is_complete_(const std::string & source)
+	{
+		std::istringstream source_code(source);
+		tokenizer lexer(source_code);
+		auto depth = 0;
+		auto open_header = false;		//a 'function' whose body has not started yet
+		auto open_tail = false;		//the last token needs something after it
+
+		try
+		{
+			for (auto current = lexer.get_token(); current->get_type() != token_categories::END; current = lexer.get_token())
+			{
+				open_tail = false;
+				if (current->get_type() == token_categories::KEYWORD)
+				{
+					switch (get_value<keyword>(current))
+					{
+					case keyword_categories::FUNCTION:
+						open_header = true;
+						break;
+					case keyword_categories::BEGIN:
+						open_header = false;
+						++depth;
+						break;
+					case keyword_categories::END:
+						--depth;
+						break;
+					case keyword_categories::THEN:
+					case keyword_categories::ELSE:
+					case keyword_categories::IN:
+						open_tail = true;
+						break;
+					default:
+						break;
+					}
+				}
+				else if (current->get_type() == token_categories::OPERATOR)
+				{
+					switch (get_value<op>(current))
+					{
+					case operator_categories::LBRACKET:
+					case operator_categories::LSQUARE:
+						++depth;
+						break;
+					case operator_categories::RBRACKET:
+					case operator_categories::RSQUARE:
+						--depth;
+						break;
+					case operator_categories::SEMI:
+						break;
+					default:
+						open_tail = true;
+						break;
+					}
+				}
+			}
+		}
+		catch (std::exception &)
+		{
+			//let the parser report it
+			return true;
+		}
+		return depth <= 0 && !open_header && !open_tail;
+	}
+
+	void repl::run_piece_(const std::string & source)
+	{
+		auto start = benchmark::now_ns();
+		try
+		{
+			std::istringstream source_code(source);
+			parser_.parse(source_code);
+		}
+		catch (std::exception & e)
+		{
+			lib::flush();
+			std::cerr << e.what() << std::endl;
+		}
+		lib::flush();
+
+		if (latency_report_)
+		{
+			char report[64];
+			std::snprintf(report, sizeof(report), "(%.2f ms)\n", (benchmark::now_ns() - start) / 1e6);
+			*latency_report_ << report << std::flush;
+		}
+	}
+
+	void repl::run(std::istream & input, std::ostream * prompt)
+	{
+		std::string source;
+		std::string line;
+		while (true)
+		{
+			if (prompt)
+				*prompt << (source.empty() ? "> " : "... ") << std::flush;
+			if (!std::getline(input, line))
+				break;
+
+			source += line;
+			source += '\n';
+			if (is_complete_(source))
+			{
+				run_piece_(source);
+				source.clear();
+			}
+		}
+
+		//input ended inside an unfinished piece, the parser reports what is missing
+		if (!source.empty())
+			run_piece_(source);
+	}
+}
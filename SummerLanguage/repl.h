@@ -0,0 +1,41 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+namespace summer_lang
+{
+	class parser;
+
+	//Reads definitions and expressions line by line and runs every piece as soon as it is complete.
+	//All pieces go through one parser and one JIT session, so functions defined earlier stay compiled,
+	//and an error only discards the piece it occurred in.
+	//The first expression after new definitions also compiles them, in an engine of their own that is kept;
+	//they are not compiled as soon as they are entered, since a definition may call one entered after it.
+	class repl
+	{
+		parser & parser_;
+		std::ostream * latency_report_;
+
+		static bool is_complete_(const std::string & source);
+		void run_piece_(const std::string & source);
+	public:
+		repl(const repl &) = delete;
+		repl & operator=(const repl &) = delete;
+
+		repl(parser & p)
+			: parser_(p)
+			, latency_report_(nullptr)
+		{
+		}
+
+		//the time from a complete piece to its result, compilation and run included, is written to 'report' after every piece
+		void report_latency(std::ostream & report)
+		{
+			latency_report_ = &report;
+		}
+
+		//prompts are written to 'prompt' when it is not null, errors always go to std::cerr
+		void run(std::istream & input, std::ostream * prompt);
+	};
+}
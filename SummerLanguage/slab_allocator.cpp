@@ -0,0 +1,140 @@
+#include "slab_allocator.h"
+#include <llvm\Support\Process.h>
+#include <algorithm>
+
+namespace summer_lang
+{
+	slab_allocator::slab_allocator(std::size_t slab_size)
+		: slab_size_(slab_size)
+		, page_size_(llvm::sys::Process::getPageSize())
+		, statistics_()
+	{
+		slab_size_ = round_to_page_(slab_size_);
+	}
+
+	slab_allocator::~slab_allocator()
+	{
+		for (auto & slabs : slabs_)
+			for (auto & s : slabs)
+				llvm::sys::Memory::releaseMappedMemory(s.block);
+	}
+
+	std::size_t slab_allocator::round_to_page_(std::size_t size) const
+	{
+		return (size + page_size_ - 1) / page_size_ * page_size_;
+	}
+
+	slab_allocator::slab * slab_allocator::find_slab_(section_categories category, const uint8_t * address)
+	{
+		for (auto & s : slabs_[static_cast<int>(category)])
+		{
+			auto base = static_cast<const uint8_t *>(s.block.base());
+			if (address >= base && address < base + s.block.size())
+				return &s;
+		}
+		return nullptr;
+	}
+
+	uint8_t * slab_allocator::allocate(section_categories category, std::size_t size, unsigned alignment)
+	{
+		if (!alignment)
+			alignment = 16;
+
+		auto & slabs = slabs_[static_cast<int>(category)];
+		for (auto pass = 0; pass != 2; ++pass)
+		{
+			for (auto & s : slabs)
+			{
+				auto base = reinterpret_cast<uintptr_t>(s.block.base());
+				auto start = (base + s.used + alignment - 1) & ~(uintptr_t(alignment) - 1);
+				auto offset = start - base;
+				if (offset + size > s.block.size())
+					continue;
+
+				statistics_.slack += offset - s.used;
+				s.slack += offset - s.used;
+				statistics_.used += offset + size - s.used;
+				statistics_.live += size;
+				s.used = offset + size;
+				s.live += size;
+				return reinterpret_cast<uint8_t *>(start);
+			}
+
+			if (pass)
+				break;
+
+			std::error_code error;
+			auto near_block = slabs.empty() ? nullptr : &slabs.back().block;
+			auto block = llvm::sys::Memory::allocateMappedMemory(std::max(slab_size_, round_to_page_(size + alignment)), near_block,
+				llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE, error);
+			if (error)
+				return nullptr;
+
+			slabs.push_back(slab{ block, 0, 0, 0, 0 });
+			statistics_.reserved += block.size();
+			statistics_.slabs++;
+		}
+		return nullptr;
+	}
+
+	void slab_allocator::release(section_categories category, uint8_t * address, std::size_t size)
+	{
+		auto s = find_slab_(category, address);
+		if (!s)
+			return;
+
+		s->live -= size;
+		statistics_.live -= size;
+		if (s->live)
+			return;
+
+		//every section in the slab is dead, so it can be rewound and filled again
+		if (s->finalized && category != section_categories::DATA)
+		{
+			llvm::sys::Memory::protectMappedMemory(llvm::sys::MemoryBlock(s->block.base(), s->finalized), llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE);
+			statistics_.protections++;
+		}
+		statistics_.used -= s->used;
+		statistics_.slack -= s->slack;
+		s->used = 0;
+		s->slack = 0;
+		s->finalized = 0;
+	}
+
+	bool slab_allocator::finalize(std::string * error_str)
+	{
+		for (auto category : { section_categories::CODE, section_categories::READ_ONLY_DATA })
+		{
+			auto flags = category == section_categories::CODE
+				? llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC
+				: llvm::sys::Memory::MF_READ;
+
+			for (auto & s : slabs_[static_cast<int>(category)])
+			{
+				if (s.used == s.finalized)
+					continue;
+
+				//the rest of the last page is given up, later sections must not land in a protected page
+				auto end = std::min(round_to_page_(s.used), s.block.size());
+				llvm::sys::MemoryBlock range(static_cast<uint8_t *>(s.block.base()) + s.finalized, end - s.finalized);
+				if (auto error = llvm::sys::Memory::protectMappedMemory(range, flags))
+				{
+					if (error_str)
+						*error_str = error.message();
+					return true;
+				}
+				statistics_.protections++;
+
+				if (category == section_categories::CODE)
+					llvm::sys::Memory::InvalidateInstructionCache(range.base(), range.size());
+
+				statistics_.slack += end - s.used;
+				s.slack += end - s.used;
+				statistics_.used += end - s.used;
+				s.used = end;
+				s.finalized = end;
+			}
+		}
+		return false;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <llvm\Support\Memory.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace summer_lang
+{
+	enum class section_categories
+	{
+		CODE,
+		READ_ONLY_DATA,
+		DATA
+	};
+
+	struct slab_statistics
+	{
+		std::size_t reserved;		//bytes mapped from the system
+		std::size_t used;			//bytes below the bump pointers, including slack
+		std::size_t live;			//bytes of sections that are still owned by a module
+		std::size_t slack;			//bytes lost to alignment and to page rounding at finalize time
+		std::size_t slabs;
+		std::size_t protections;	//number of permission changes issued
+
+		double fragmentation() const
+		{
+			return used ? 1.0 - double(live) / double(used) : 0.0;
+		}
+	};
+
+	//Packs the sections of many modules into a few large mappings.
+	//Sections are handed out with a bump pointer and stay writable until finalize(),
+	//which changes the permission of all pages written since the last call at once.
+	//A slab whose sections have all been released is rewound and reused.
+	class slab_allocator
+	{
+		struct slab
+		{
+			llvm::sys::MemoryBlock block;
+			std::size_t used;
+			std::size_t finalized;
+			std::size_t live;
+			std::size_t slack;
+		};
+
+		std::vector<slab> slabs_[3];
+		std::size_t slab_size_;
+		std::size_t page_size_;
+		slab_statistics statistics_;
+
+		slab * find_slab_(section_categories category, const uint8_t * address);
+		std::size_t round_to_page_(std::size_t size) const;
+	public:
+		slab_allocator(const slab_allocator &) = delete;
+		slab_allocator & operator=(const slab_allocator &) = delete;
+
+		slab_allocator(std::size_t slab_size = 1 << 20);
+		~slab_allocator();
+
+		uint8_t * allocate(section_categories category, std::size_t size, unsigned alignment);
+		void release(section_categories category, uint8_t * address, std::size_t size);
+		bool finalize(std::string * error_str);
+
+		const slab_statistics & get_statistics() const
+		{
+			return statistics_;
+		}
+	};
+}
@@ -0,0 +1,147 @@
+#include "statistics.h"
+#include <iomanip>
+
+namespace summer_lang
+{
+	static const char * phase_names[phase_count] = { "lex", "parse", "codegen", "optimize", "emit" };
+
+	//machine code is emitted per module, so the function records stop before this phase
+	static const int emit_phase = static_cast<int>(phase_categories::EMIT);
+
+	static std::string escape_json(const std::string & str)
+	{
+		std::string result;
+		for (auto ch : str)
+		{
+			switch (ch)
+			{
+			case '"':
+				result += "\\\"";
+				break;
+			case '\\':
+				result += "\\\\";
+				break;
+			default:
+				result += ch;
+				break;
+			}
+		}
+		return result;
+	}
+
+	function_statistics & compile_statistics::begin_function(int start_row_no)
+	{
+		functions_.push_back(function_statistics());
+		functions_.back().start_row_no = start_row_no;
+		return functions_.back();
+	}
+
+	function_statistics * compile_statistics::find_function(const std::string & name)
+	{
+		for (auto i = functions_.rbegin(); i != functions_.rend(); ++i)
+			if (i->name == name)
+				return &*i;
+		return nullptr;
+	}
+
+	void compile_statistics::add_module(module_statistics module)
+	{
+		modules_.push_back(std::move(module));
+	}
+
+	void compile_statistics::report(std::ostream & out) const
+	{
+		double total[phase_count] = {};
+		std::size_t tokens = 0, ast_nodes = 0, ir_instructions = 0, machine_code_bytes = 0;
+
+		out << "===== Summer compile time report =====" << std::endl;
+		out << std::left << std::setw(24) << "function" << std::right;
+		for (auto i = 0; i != emit_phase; ++i)
+			out << std::setw(11) << (std::string(phase_names[i]) + "(ms)");
+		out << std::setw(9) << "tokens" << std::setw(9) << "nodes" << std::setw(9) << "instrs" << std::endl;
+
+		out << std::fixed << std::setprecision(3);
+		for (auto & function : functions_)
+		{
+			out << std::left << std::setw(24) << (function.name + ":" + std::to_string(function.start_row_no)) << std::right;
+			for (auto i = 0; i != emit_phase; ++i)
+			{
+				out << std::setw(11) << function.seconds[i] * 1000;
+				total[i] += function.seconds[i];
+			}
+			out << std::setw(9) << function.tokens << std::setw(9) << function.ast_nodes << std::setw(9) << function.ir_instructions << std::endl;
+
+			tokens += function.tokens;
+			ast_nodes += function.ast_nodes;
+			ir_instructions += function.ir_instructions;
+		}
+
+		out << std::endl << std::left << std::setw(48) << "module" << std::right << std::setw(11) << "emit(ms)" << std::setw(14) << "code bytes" << std::endl;
+		for (auto & module : modules_)
+		{
+			std::string names;
+			for (auto & name : module.functions)
+				names += (names.empty() ? "" : ", ") + name;
+
+			out << std::left << std::setw(48) << names << std::right << std::setw(11) << module.emit_seconds * 1000 << std::setw(14) << module.machine_code_bytes << std::endl;
+			total[emit_phase] += module.emit_seconds;
+			machine_code_bytes += module.machine_code_bytes;
+		}
+
+		out << std::endl << "total:";
+		for (auto i = 0; i != phase_count; ++i)
+			out << " " << phase_names[i] << " " << total[i] * 1000 << " ms,";
+		out << " " << tokens << " tokens, " << ast_nodes << " AST nodes, " << ir_instructions << " IR instructions, "
+			<< machine_code_bytes << " bytes of machine code" << std::endl;
+		out << "resident JIT memory: " << resident_memory_ << " bytes" << std::endl;
+		out << "JIT slabs: " << slabs_.slabs << " slabs, " << slabs_.reserved << " bytes reserved, " << slabs_.used << " used, "
+			<< slabs_.live << " live, " << slabs_.slack << " slack, " << slabs_.fragmentation() * 100 << "% fragmentation, "
+			<< slabs_.protections << " protection changes" << std::endl;
+		out.unsetf(std::ios::fixed);
+	}
+
+	void compile_statistics::report_json(std::ostream & out) const
+	{
+		double total[phase_count] = {};
+		std::size_t tokens = 0, ast_nodes = 0, ir_instructions = 0, machine_code_bytes = 0;
+
+		out << "{\"functions\":[";
+		for (std::size_t i = 0; i != functions_.size(); ++i)
+		{
+			auto & function = functions_[i];
+			out << (i ? "," : "") << "{\"name\":\"" << escape_json(function.name) << "\",\"line\":" << function.start_row_no;
+			for (auto j = 0; j != emit_phase; ++j)
+			{
+				out << ",\"" << phase_names[j] << "_ms\":" << function.seconds[j] * 1000;
+				total[j] += function.seconds[j];
+			}
+			out << ",\"tokens\":" << function.tokens << ",\"ast_nodes\":" << function.ast_nodes << ",\"ir_instructions\":" << function.ir_instructions << "}";
+
+			tokens += function.tokens;
+			ast_nodes += function.ast_nodes;
+			ir_instructions += function.ir_instructions;
+		}
+
+		out << "],\"modules\":[";
+		for (std::size_t i = 0; i != modules_.size(); ++i)
+		{
+			auto & module = modules_[i];
+			out << (i ? "," : "") << "{\"functions\":[";
+			for (std::size_t j = 0; j != module.functions.size(); ++j)
+				out << (j ? "," : "") << "\"" << escape_json(module.functions[j]) << "\"";
+			out << "],\"emit_ms\":" << module.emit_seconds * 1000 << ",\"machine_code_bytes\":" << module.machine_code_bytes << "}";
+
+			total[emit_phase] += module.emit_seconds;
+			machine_code_bytes += module.machine_code_bytes;
+		}
+
+		out << "],\"total\":{";
+		for (auto i = 0; i != phase_count; ++i)
+			out << "\"" << phase_names[i] << "_ms\":" << total[i] * 1000 << ",";
+		out << "\"tokens\":" << tokens << ",\"ast_nodes\":" << ast_nodes << ",\"ir_instructions\":" << ir_instructions
+			<< ",\"machine_code_bytes\":" << machine_code_bytes << ",\"resident_memory\":" << resident_memory_ << "}";
+		out << ",\"slabs\":{\"count\":" << slabs_.slabs << ",\"reserved\":" << slabs_.reserved << ",\"used\":" << slabs_.used
+			<< ",\"live\":" << slabs_.live << ",\"slack\":" << slabs_.slack << ",\"fragmentation\":" << slabs_.fragmentation()
+			<< ",\"protections\":" << slabs_.protections << "}}" << std::endl;
+	}
+}
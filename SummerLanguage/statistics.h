@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "slab_allocator.h"
+
+namespace summer_lang
+{
+	enum class phase_categories
+	{
+		LEX,
+		PARSE,
+		CODEGEN,
+		OPTIMIZE,
+		EMIT
+	};
+
+	const int phase_count = 5;
+
+	struct function_statistics
+	{
+		std::string name;
+		int start_row_no;
+		double seconds[phase_count];
+		std::size_t tokens;
+		std::size_t ast_nodes;
+		std::size_t ir_instructions;
+	};
+
+	struct module_statistics
+	{
+		std::vector<std::string> functions;
+		double emit_seconds;
+		std::size_t machine_code_bytes;
+	};
+
+	class compile_statistics
+	{
+		std::vector<function_statistics> functions_;
+		std::vector<module_statistics> modules_;
+		std::size_t resident_memory_;
+		slab_statistics slabs_;
+	public:
+		compile_statistics(const compile_statistics &) = delete;
+		compile_statistics & operator=(const compile_statistics &) = delete;
+
+		compile_statistics()
+			: resident_memory_(0)
+			, slabs_()
+		{
+		}
+
+		function_statistics & begin_function(int start_row_no);
+		function_statistics * find_function(const std::string & name);
+		void add_module(module_statistics module);
+
+		void set_memory(std::size_t resident_bytes, const slab_statistics & slabs)
+		{
+			resident_memory_ = resident_bytes;
+			slabs_ = slabs;
+		}
+
+		void report(std::ostream & out) const;
+		void report_json(std::ostream & out) const;
+	};
+
+	//adds the wall time of its own lifetime to a counter
+	class phase_timer
+	{
+		double * seconds_;
+		std::chrono::steady_clock::time_point start_;
+	public:
+		phase_timer(const phase_timer &) = delete;
+		phase_timer & operator=(const phase_timer &) = delete;
+
+		phase_timer(double * seconds)
+			: seconds_(seconds)
+		{
+			if (seconds_)
+				start_ = std::chrono::steady_clock::now();
+		}
+
+		~phase_timer()
+		{
+			if (seconds_)
+				*seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+		}
+	};
+}
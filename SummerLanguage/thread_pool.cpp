@@ -0,0 +1,270 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace summer_lang
+{
+	static const std::size_t no_worker = static_cast<std::size_t>(-1);
+	static thread_local std::size_t worker_index = no_worker;
+	static thread_local void * current_group = nullptr;
+
+	static std::size_t configured_workers = no_worker;
+	static std::int64_t configured_grain = 0;
+
+	double reduction_identity(reduction_categories op)
+	{
+		switch (op)
+		{
+		case reduction_categories::MUL:
+			return 1.0;
+		case reduction_categories::MIN:
+			return std::numeric_limits<double>::infinity();
+		case reduction_categories::MAX:
+			return -std::numeric_limits<double>::infinity();
+		default:
+			return 0.0;
+		}
+	}
+
+	//same results as the instructions codegen emits for the operators
+	double reduction_combine(reduction_categories op, double left, double right)
+	{
+		switch (op)
+		{
+		case reduction_categories::MUL:
+			return left * right;
+		case reduction_categories::MIN:
+			return std::fmin(left, right);
+		case reduction_categories::MAX:
+			return std::fmax(left, right);
+		default:
+			return left + right;
+		}
+	}
+
+	thread_pool::thread_pool(std::size_t workers, std::int64_t grain)
+		: pending_(0)
+		, stop_(false)
+		, grain_(grain)
+	{
+		for (std::size_t i = 0; i != workers + 1; ++i)
+			queues_.push_back(std::make_unique<task_queue>());
+		for (std::size_t i = 0; i != workers; ++i)
+			workers_.emplace_back(&thread_pool::work_, this, i);
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+			stop_ = true;
+		}
+		wake_up_.notify_all();
+		for (auto & worker : workers_)
+			worker.join();
+	}
+
+	thread_pool::task_queue & thread_pool::own_queue_()
+	{
+		return *queues_[worker_index == no_worker ? queues_.size() - 1 : worker_index];
+	}
+
+	void thread_pool::push_(range_task task)
+	{
+		{
+			auto & queue = own_queue_();
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(task);
+		}
+		++pending_;
+
+		//the lock orders the increment before a worker that is about to sleep checks it
+		{
+			std::lock_guard<std::mutex> lock(sleep_mutex_);
+		}
+		wake_up_.notify_one();
+	}
+
+	//the newest task is the smallest and the one whose data is still in the cache
+	bool thread_pool::pop_(range_task & task)
+	{
+		auto & queue = own_queue_();
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			return false;
+
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+		--pending_;
+		return true;
+	}
+
+	bool thread_pool::steal_(range_task & task)
+	{
+		auto start = worker_index == no_worker ? 0 : worker_index + 1;
+		for (std::size_t i = 0; i != queues_.size(); ++i)
+		{
+			auto & queue = *queues_[(start + i) % queues_.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			--pending_;
+			return true;
+		}
+		return false;
+	}
+
+	void thread_pool::run_(range_task task)
+	{
+		while (task.hi - task.lo > task.owner->grain)
+		{
+			auto middle = task.lo + (task.hi - task.lo) / 2;
+			push_(range_task{ task.owner, middle, task.hi });
+			task.hi = middle;
+		}
+
+		auto owner = task.owner;
+		auto previous_group = current_group;
+		current_group = owner->group;
+		if (owner->reduce)
+		{
+			auto partial = owner->reduce(owner->env, task.lo, task.hi);
+			std::lock_guard<std::mutex> lock(owner->result_mutex);
+			owner->result = reduction_combine(owner->op, owner->result, partial);
+		}
+		else if (owner->call)
+			owner->result = owner->call(owner->env);
+		else
+			owner->body(owner->env, task.lo, task.hi);
+		current_group = previous_group;
+		owner->remaining -= task.hi - task.lo;
+	}
+
+	void thread_pool::work_(std::size_t index)
+	{
+		worker_index = index;
+		while (true)
+		{
+			range_task task;
+			if (pop_(task) || steal_(task))
+			{
+				run_(task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleep_mutex_);
+			wake_up_.wait(lock, [this] { return stop_ || pending_ > 0; });
+			if (stop_)
+				return;
+		}
+	}
+
+	void thread_pool::run_job_(job & loop, std::int64_t count)
+	{
+		loop.grain = grain_ ? grain_ : std::max<std::int64_t>(1, count / (8 * static_cast<std::int64_t>(workers_.size() + 1)));
+		loop.remaining = count;
+
+		//the starting thread works on the loop, and on whatever it can steal, until every iteration is done
+		run_(range_task{ &loop, 0, count });
+		help_until_done_(loop);
+	}
+
+	void thread_pool::help_until_done_(job & task)
+	{
+		while (task.remaining > 0)
+		{
+			range_task other;
+			if (pop_(other) || steal_(other))
+				run_(other);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	void thread_pool::parallel_for(parallel_body body, void * env, std::int64_t count)
+	{
+		if (count <= 0)
+			return;
+		if (workers_.empty())
+		{
+			body(env, 0, count);
+			return;
+		}
+
+		job loop;
+		loop.body = body;
+		loop.reduce = nullptr;
+		loop.call = nullptr;
+		loop.op = reduction_categories::NONE;
+		loop.env = env;
+		loop.group = current_group;
+		run_job_(loop, count);
+	}
+
+	double thread_pool::parallel_reduce(reduction_body body, reduction_categories op, void * env, std::int64_t count)
+	{
+		if (count <= 0)
+			return reduction_identity(op);
+		if (workers_.empty())
+			return body(env, 0, count);
+
+		job loop;
+		loop.body = nullptr;
+		loop.reduce = body;
+		loop.call = nullptr;
+		loop.op = op;
+		loop.env = env;
+		loop.group = current_group;
+		loop.result = reduction_identity(op);
+		run_job_(loop, count);
+		return loop.result;
+	}
+
+	thread_pool::job * thread_pool::spawn(spawn_body body, void * env)
+	{
+		auto task = new job;
+		task->body = nullptr;
+		task->reduce = nullptr;
+		task->call = body;
+		task->op = reduction_categories::NONE;
+		task->env = env;
+		task->group = current_group;
+		task->grain = 1;
+		task->remaining = 1;
+		task->result = 0.0;
+		push_(range_task{ task, 0, 1 });
+		return task;
+	}
+
+	double thread_pool::wait(job & task)
+	{
+		help_until_done_(task);
+		return task.result;
+	}
+
+	void * thread_pool::get_group()
+	{
+		return current_group;
+	}
+
+	void thread_pool::set_group(void * group)
+	{
+		current_group = group;
+	}
+
+	void thread_pool::configure(std::size_t workers, std::int64_t grain)
+	{
+		configured_workers = workers;
+		configured_grain = grain;
+	}
+
+	thread_pool & thread_pool::get()
+	{
+		static thread_pool pool(configured_workers != no_worker ? configured_workers : std::max(1u, std::thread::hardware_concurrency()) - 1, configured_grain);
+		return pool;
+	}
+}
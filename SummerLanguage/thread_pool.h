@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace summer_lang
+{
+	//signature of the function a 'parallel for' body is outlined into
+	typedef void(*parallel_body)(void * env, std::int64_t lo, std::int64_t hi);
+	//the body of a loop with a 'reduce' clause returns the partial result of its iterations
+	typedef double(*reduction_body)(void * env, std::int64_t lo, std::int64_t hi);
+	//a call started by 'spawn'
+	typedef double(*spawn_body)(void * env);
+
+	//operators of 'reduce(op: var)', the values are passed to the runtime by generated code
+	enum class reduction_categories
+	{
+		NONE,
+		ADD,
+		MUL,
+		MIN,
+		MAX
+	};
+
+	double reduction_identity(reduction_categories op);
+	double reduction_combine(reduction_categories op, double left, double right);
+
+	//Runs the iterations of 'parallel for' loops on a fixed set of workers.
+	//A range is split in halves until it is no larger than the grain; every worker keeps the halves it
+	//splits off in its own deque and idle workers steal the oldest, largest, ranges from the others.
+	//The thread that starts a loop helps running it, so loops may nest.
+	//Spawned calls are single-iteration jobs, a thread waiting for one runs other tasks meanwhile.
+	class thread_pool
+	{
+	public:
+		struct job
+		{
+			parallel_body body;
+			reduction_body reduce;
+			spawn_body call;
+			reduction_categories op;
+			void * env;
+			void * group;		//of the thread that started the job, its tasks run with it wherever they run
+			std::int64_t grain;
+			std::atomic<std::int64_t> remaining;		//iterations that have not finished yet
+			std::mutex result_mutex;
+			double result;
+		};
+	private:
+		struct range_task
+		{
+			job * owner;
+			std::int64_t lo, hi;
+		};
+
+		struct task_queue
+		{
+			std::mutex mutex;
+			std::deque<range_task> tasks;
+		};
+
+		std::vector<std::unique_ptr<task_queue>> queues_;		//one per worker, the last one is shared by other threads
+		std::vector<std::thread> workers_;
+		std::atomic<std::int64_t> pending_;
+		std::mutex sleep_mutex_;
+		std::condition_variable wake_up_;
+		bool stop_;
+		std::int64_t grain_;
+
+		task_queue & own_queue_();
+		void push_(range_task task);
+		bool pop_(range_task & task);
+		bool steal_(range_task & task);
+		void run_(range_task task);
+		void work_(std::size_t index);
+		void run_job_(job & loop, std::int64_t count);
+		void help_until_done_(job & task);
+	public:
+		thread_pool(const thread_pool &) = delete;
+		thread_pool & operator=(const thread_pool &) = delete;
+
+		//0 workers runs every loop on the calling thread, a grain of 0 picks one per loop
+		thread_pool(std::size_t workers, std::int64_t grain);
+		~thread_pool();
+
+		void parallel_for(parallel_body body, void * env, std::int64_t count);
+		//chunks are combined in no particular order, so 'op' must be associative and commutative
+		double parallel_reduce(reduction_body body, reduction_categories op, void * env, std::int64_t count);
+
+		//the job is owned by the caller, who must wait for it before deleting it
+		job * spawn(spawn_body body, void * env);
+		double wait(job & task);
+
+		std::size_t get_worker_count() const
+		{
+			return workers_.size();
+		}
+
+		//an opaque per-thread value the runtime uses to find the futures a call belongs to
+		static void * get_group();
+		static void set_group(void * group);
+
+		//must be called before the first loop runs, later calls have no effect
+		static void configure(std::size_t workers, std::int64_t grain);
+		static thread_pool & get();
+	};
+}
@@ -7,116 +7,134 @@ namespace summer_lang
 {
 	std::unique_ptr<token> tokenizer::get_token()
 	{
-		static int last_char = ' ';
-		static int row_no = 1;
+		if (last_char_ == EOF)
+			return std::make_unique<end>(row_no_);
 
-		if (last_char == EOF)
-			return std::make_unique<end>(row_no);
-
-		if (std::isspace(last_char))
+		if (std::isspace(last_char_))
 		{
-			while ((last_char = source_code_.get()) != EOF && std::isspace(last_char))
-				if (last_char == '\r' || last_char == '\n')
-					row_no++;
+			while ((last_char_ = source_code_.get()) != EOF && std::isspace(last_char_))
+				if (last_char_ == '\r' || last_char_ == '\n')
+					row_no_++;
             return get_token();   
         }
             
-        if(last_char == '#')
+        if(last_char_ == '#')
         {
-            while((last_char = source_code_.get()) != EOF && (last_char != '\r' && last_char != '\n'));
-			row_no++;
+            while((last_char_ = source_code_.get()) != EOF && (last_char_ != '\r' && last_char_ != '\n'));
+			row_no_++;
             return get_token();    
         }
 
-		if (std::isalpha(last_char))
+		if (std::isalpha(last_char_))
 		{
 			auto str = std::string();
-			str += last_char;
+			str += last_char_;
 
-			while ((last_char = source_code_.get()) != EOF && (isalnum(last_char) || last_char == '_'))
-				str += last_char;
+			while ((last_char_ = source_code_.get()) != EOF && (isalnum(last_char_) || last_char_ == '_'))
+				str += last_char_;
 
 			if (str == "extern")
-				return std::make_unique<keyword>(keyword_categories::EXTERN, row_no);
+				return std::make_unique<keyword>(keyword_categories::EXTERN, row_no_);
 
 			if (str == "function")
-				return std::make_unique<keyword>(keyword_categories::FUNCTION, row_no);
+				return std::make_unique<keyword>(keyword_categories::FUNCTION, row_no_);
 
 			if (str == "if")
-				return std::make_unique<keyword>(keyword_categories::IF, row_no);
+				return std::make_unique<keyword>(keyword_categories::IF, row_no_);
 
 			if (str == "then")
-				return std::make_unique<keyword>(keyword_categories::THEN, row_no);
+				return std::make_unique<keyword>(keyword_categories::THEN, row_no_);
 
 			if (str == "else")
-				return std::make_unique<keyword>(keyword_categories::ELSE, row_no);
+				return std::make_unique<keyword>(keyword_categories::ELSE, row_no_);
 
 			if (str == "for")
-				return std::make_unique<keyword>(keyword_categories::FOR, row_no);
+				return std::make_unique<keyword>(keyword_categories::FOR, row_no_);
 
 			if (str == "in")
-				return std::make_unique<keyword>(keyword_categories::IN, row_no);
+				return std::make_unique<keyword>(keyword_categories::IN, row_no_);
 
 			if (str == "unary")
-				return std::make_unique<keyword>(keyword_categories::UNARY, row_no);
+				return std::make_unique<keyword>(keyword_categories::UNARY, row_no_);
 
 			if (str == "binary")
-				return std::make_unique<keyword>(keyword_categories::BINARY, row_no);
+				return std::make_unique<keyword>(keyword_categories::BINARY, row_no_);
+
+			if (str == "fastmath")
+				return std::make_unique<keyword>(keyword_categories::FASTMATH, row_no_);
+
+			if (str == "import")
+				return std::make_unique<keyword>(keyword_categories::IMPORT, row_no_);
+
+			if (str == "parallel")
+				return std::make_unique<keyword>(keyword_categories::PARALLEL, row_no_);
+
+			if (str == "reduce")
+				return std::make_unique<keyword>(keyword_categories::REDUCE, row_no_);
+
+			if (str == "spawn")
+				return std::make_unique<keyword>(keyword_categories::SPAWN, row_no_);
+
+			if (str == "bench")
+				return std::make_unique<keyword>(keyword_categories::BENCH, row_no_);
 
 			if (str == "var")
-				return std::make_unique<keyword>(keyword_categories::VAR, row_no);
+				return std::make_unique<keyword>(keyword_categories::VAR, row_no_);
 
 			if (str == "begin")
-				return std::make_unique<keyword>(keyword_categories::BEGIN, row_no);
+				return std::make_unique<keyword>(keyword_categories::BEGIN, row_no_);
 
 			if (str == "end")
-				return std::make_unique<keyword>(keyword_categories::END, row_no);
+				return std::make_unique<keyword>(keyword_categories::END, row_no_);
 
 			if (str == "return")
-				return std::make_unique<keyword>(keyword_categories::RETURN, row_no);
+				return std::make_unique<keyword>(keyword_categories::RETURN, row_no_);
 
 			if (str == "number")
-				return std::make_unique<type>(type_categories::NUMBER, row_no);
+				return std::make_unique<type>(type_categories::NUMBER, row_no_);
 
 			if (str == "void")
-				return std::make_unique<type>(type_categories::VOID, row_no);
+				return std::make_unique<type>(type_categories::VOID, row_no_);
 
 			if (str == "string")
-				return std::make_unique<type>(type_categories::STRING, row_no);
+				return std::make_unique<type>(type_categories::STRING, row_no_);
+
+			if (str == "future")
+				return std::make_unique<type>(type_categories::FUTURE, row_no_);
 
-			return std::make_unique<identifier>(str, row_no);
+			return std::make_unique<identifier>(str, row_no_);
 		}
 
-		if (std::isdigit(last_char) || last_char == '.')
+		if (std::isdigit(last_char_) || last_char_ == '.')
 		{
 			auto num_str = std::string();
-			num_str += last_char;
+			num_str += last_char_;
 
-			while ((last_char = source_code_.get()) != EOF && (std::isdigit(last_char) || last_char == '.'))
-				num_str += last_char;
+			while ((last_char_ = source_code_.get()) != EOF && (std::isdigit(last_char_) || last_char_ == '.'))
+				num_str += last_char_;
 
 			auto num = std::strtod(num_str.c_str(), nullptr);
-			return std::make_unique<literal_number>(num, row_no);
+			return std::make_unique<literal_number>(num, row_no_);
 		}
 
-		if (last_char == '\'')
+		if (last_char_ == '\'')
 		{
 			auto ch_str = std::string();
 
-			while ((last_char = source_code_.get()) != EOF && last_char != '\'')
-				ch_str += last_char;
+			while ((last_char_ = source_code_.get()) != EOF && last_char_ != '\'')
+				ch_str += last_char_;
 
-			if (last_char == '\'')
-				last_char = source_code_.get();
+			if (last_char_ == '\'')
+				last_char_ = source_code_.get();
 			else
-				throw lexical_error("Illegal format of character", row_no);
+				throw lexical_error("Illegal format of character", row_no_);
 
 			
 			char ch;
 			if (ch_str.length() == 1)
 			{
 				ch = ch_str[0];
-				return std::make_unique<literal_char>(ch, row_no);
+				return std::make_unique<literal_char>(ch, row_no_);
 			}
 			else
 			{
@@ -142,28 +160,28 @@ namespace summer_lang
 							ch = '\'';
 							break;
 						default:
-							throw lexical_error("Illegal format of character", row_no);
+							throw lexical_error("Illegal format of character", row_no_);
 						}
-						return std::make_unique<literal_char>(ch, row_no);
+						return std::make_unique<literal_char>(ch, row_no_);
 					}
 				}
-				throw lexical_error("Illegal format of character", row_no);
+				throw lexical_error("Illegal format of character", row_no_);
 			}
 		}
 
-		if (last_char == '"')
+		if (last_char_ == '"')
 		{
 			auto str = std::string();
 
-			while ((last_char = source_code_.get()) != EOF && last_char != '"')
+			while ((last_char_ = source_code_.get()) != EOF && last_char_ != '"')
 			{
-				auto ch = last_char;
-				if (last_char == '\\')
+				auto ch = last_char_;
+				if (last_char_ == '\\')
 				{
-					last_char = source_code_.get();
-					if(last_char == EOF)
-						throw lexical_error("Illegal format of string", row_no);
-					switch (last_char)
+					last_char_ = source_code_.get();
+					if(last_char_ == EOF)
+						throw lexical_error("Illegal format of string", row_no_);
+					switch (last_char_)
 					{
 					case 'n':
 						ch = '\n';
@@ -181,25 +199,25 @@ namespace summer_lang
 						ch = '\'';
 						break;
 					default:
-						throw lexical_error("Illegal format of character", row_no);
+						throw lexical_error("Illegal format of character", row_no_);
 					}
 				}
 				str += ch;
 			}
 
-			if (last_char == '"')
-				last_char = source_code_.get();
+			if (last_char_ == '"')
+				last_char_ = source_code_.get();
 			else
-				throw lexical_error("Illegal format of string", row_no);
+				throw lexical_error("Illegal format of string", row_no_);
 
-			return std::make_unique<literal_string>(str, row_no);
+			return std::make_unique<literal_string>(str, row_no_);
 		}
 
 		operator_categories type;
 		auto need_eat = true;
 		auto operator_str = std::string();
 
-		switch (last_char)
+		switch (last_char_)
 		{
 		case ';':
 			type = operator_categories::SEMI;
@@ -208,12 +226,12 @@ namespace summer_lang
 		case '<':
 			type = operator_categories::LT;
 			operator_str += '<';
-			last_char = source_code_.get();
-			if (last_char != '=' && last_char != '>')
+			last_char_ = source_code_.get();
+			if (last_char_ != '=' && last_char_ != '>')
 				need_eat = false;
 			else
 			{
-				if (last_char == '=')
+				if (last_char_ == '=')
 				{
 					operator_str += '=';
 					type = operator_categories::LE;
@@ -228,8 +246,8 @@ namespace summer_lang
 		case '>':
 			type = operator_categories::GT;
 			operator_str += '>';
-			last_char = source_code_.get();
-			if (last_char != '=')
+			last_char_ = source_code_.get();
+			if (last_char_ != '=')
 				need_eat = false;
 			else
 			{
@@ -248,8 +266,8 @@ namespace summer_lang
 		case '-':
 			type = operator_categories::SUB;
 			operator_str += '-';
-			last_char = source_code_.get();
-			if (last_char != '>')
+			last_char_ = source_code_.get();
+			if (last_char_ != '>')
 				need_eat = false;
 			else
 			{
@@ -273,6 +291,14 @@ namespace summer_lang
 			type = operator_categories::RBRACKET;
 			operator_str += ')';
 			break;
+		case '[':
+			type = operator_categories::LSQUARE;
+			operator_str += '[';
+			break;
+		case ']':
+			type = operator_categories::RSQUARE;
+			operator_str += ']';
+			break;
 		case ',':
 			type = operator_categories::COMM;
 			operator_str += ',';
@@ -280,8 +306,8 @@ namespace summer_lang
 		case '=':
 			type = operator_categories::ASSIGN;
 			operator_str += '=';
-			last_char = source_code_.get();
-			if (last_char != '=')
+			last_char_ = source_code_.get();
+			if (last_char_ != '=')
 				need_eat = false;
 			else
 			{
@@ -291,14 +317,14 @@ namespace summer_lang
 			break;
 		default:
 			type = operator_categories::USER_DEFINED;
-			operator_str += last_char;
+			operator_str += last_char_;
 			break;
 		}
 
 		if (need_eat)
-			last_char = source_code_.get();
+			last_char_ = source_code_.get();
 
-		return std::make_unique<op>(type, operator_str, row_no);
+		return std::make_unique<op>(type, operator_str, row_no_);
 	}
 
 	std::string get_op_name(const std::unique_ptr<token>& tok)
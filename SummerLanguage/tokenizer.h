@@ -34,14 +34,21 @@ namespace summer_lang
 		VAR,
 		BEGIN,
 		END,
-		RETURN
+		RETURN,
+		FASTMATH,
+		IMPORT,
+		PARALLEL,
+		REDUCE,
+		SPAWN,
+		BENCH
 	};
 
 	enum class type_categories
 	{
 		VOID,
 		NUMBER,
-		STRING
+		STRING,
+		FUTURE
 	};
 
 	enum class operator_categories
@@ -58,6 +65,8 @@ namespace summer_lang
 		DIV,
 		LBRACKET,
 		RBRACKET,
+		LSQUARE,
+		RSQUARE,
 		COMM,
 		COLON,
 		SEMI,
@@ -268,12 +277,16 @@ namespace summer_lang
 	class tokenizer
 	{
 		std::istream & source_code_;
+		int last_char_;
+		int row_no_;
 	public:
 		tokenizer(const tokenizer &) = delete;
 		tokenizer & operator=(const tokenizer &) = delete;
 
 		tokenizer(std::istream & source_code)
 			: source_code_(source_code)
+			, last_char_(' ')
+			, row_no_(1)
 		{
 		}
 